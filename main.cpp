@@ -7,6 +7,7 @@
 #include <memory>
 #include <algorithm>
 #include <cstdlib>
+#include <cmath>
 #include <chrono>
 #include <thread>
 #include <sstream>
@@ -14,6 +15,11 @@
 #include <filesystem>
 #include <atomic>
 #include <mutex>
+#include <condition_variable>
+#include <cstdint>
+#include <array>
+#include <new>
+#include <cstring>
 
 // --- Platform-Specific Includes ---
 #ifdef _WIN32
@@ -22,6 +28,8 @@
     #define WIN32_LEAN_AND_MEAN
     #endif
     #define _WIN32_WINNT 0x0601
+    #include <winsock2.h>
+    #include <ws2tcpip.h>
     #include <windows.h>
     #include <hidsdi.h>
     #include <hidpi.h>
@@ -36,6 +44,14 @@
     #include <string.h>
     #include <errno.h>
     #include <poll.h>
+    #include <sys/eventfd.h>
+    #include <sys/epoll.h>
+    #include <sys/timerfd.h>
+    #include <sys/signalfd.h>
+    #include <sys/socket.h>
+    #include <netdb.h>
+    #include <signal.h>
+    #include <alsa/asoundlib.h>
     #include <cstdint>
     // Define LONG for Linux to match the Windows type used in shared code
     typedef int32_t LONG;
@@ -50,6 +66,31 @@
 using json = nlohmann::json;
 namespace fs = std::filesystem;
 const std::string CONFIG_EXTENSION = ".hidmidi.json";
+const std::string DEFAULT_VIRTUAL_PORT_NAME = "JoystickMIDI";
+
+// --- Allocation Counting ---
+// Built with -DJOYSTICKMIDI_COUNT_ALLOCATIONS=ON, every heap allocation is counted so --bench
+// can check that steady-state dispatch never allocates.
+#ifdef JOYSTICKMIDI_COUNT_ALLOCATIONS
+std::atomic<uint64_t> g_allocationCount(0);
+std::atomic<uint64_t> g_allocatedBytes(0);
+
+void* operator new(std::size_t size) {
+    g_allocationCount.fetch_add(1, std::memory_order_relaxed);
+    g_allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete" // new above is malloc-backed, so free is the match
+#endif
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+#endif
 
 // --- Data Structures ---
 struct ControlInfo {
@@ -67,99 +108,1820 @@ struct ControlInfo {
 #endif
 };
 
-struct MidiMappingConfig {
-    std::string hidDevicePath;
-    std::string hidDeviceName;
-    ControlInfo control;
-    std::string midiDeviceName;
-    enum class MidiMessageType { NONE, NOTE_ON_OFF, CC } midiMessageType = MidiMessageType::NONE;
-    int midiChannel = 0;
-    int midiNoteOrCCNumber = 0;
-    int midiValueNoteOnVelocity = 64;
-    int midiValueCCOn = 127;
-    int midiValueCCOff = 0;
-    LONG calibrationMinHid = 0;
-    LONG calibrationMaxHid = 0;
-    bool calibrationDone = false;
-    bool reverseAxis = false;
-    int midiSendIntervalMs = 1;
+struct ControlMapping {
+    ControlInfo control;
+    // CC_14BIT sends axes as an MSB/LSB pair on CC n and n+32, so n must be 0-31.
+    // PITCH_BEND ignores the number; centerDeadzone becomes its center detent.
+    // NRPN and RPN use the number as the 14-bit parameter number (0-16383).
+    enum class MidiMessageType { NONE, NOTE_ON_OFF, CC, CC_14BIT, PITCH_BEND, NRPN, RPN } midiMessageType = MidiMessageType::NONE;
+    int midiChannel = 0;
+    int midiNoteOrCCNumber = 0;
+    int midiValueNoteOnVelocity = 64;
+    int midiValueCCOn = 127;
+    int midiValueCCOff = 0;
+    LONG calibrationMinHid = 0;
+    LONG calibrationMaxHid = 0;
+    bool calibrationDone = false;
+    bool reverseAxis = false;
+    int midiSendIntervalMs = 1;
+    double centerDeadzone = 0.0; // fraction of the calibrated range around the middle that reads as centered
+    double edgeDeadzone = 0.0;   // fraction of the calibrated range at each end that reads as min/max
+    double stepHysteresis = 0.0; // how far, in output steps (0-0.5), a value must pass a step boundary to change
+    // Applied to the normalized axis position after deadzones and reversal.
+    enum class ResponseCurve { LINEAR, EXPONENTIAL, LOGARITHMIC, S_CURVE, PIECEWISE } responseCurve = ResponseCurve::LINEAR;
+    double curveAmount = 2.0;                          // strength of the exponential, logarithmic and S curves
+    std::vector<std::pair<double, double>> curvePoints; // Piecewise: (input, output) pairs in 0-1
+    enum class AxisFilter { NONE, EMA, ONE_EURO } axisFilter = AxisFilter::NONE;
+    double filterCutoffHz = 1.0;           // EMA cutoff, or the One Euro cutoff while the stick is still
+    double filterBeta = 5.0;               // One Euro: cutoff added per calibrated range/second of speed
+    double filterDerivativeCutoffHz = 1.0; // One Euro: smoothing of the speed estimate
+    enum class AxisQueuePolicy { QUEUE_ALL, COALESCE } axisQueuePolicy = AxisQueuePolicy::COALESCE;
+    // Output ports this mapping sends to: 0 is the profile's midiDeviceName, 1 the first of its
+    // midiExtraDeviceNames, and so on. Empty sends to every port.
+    std::vector<int> midiPorts;
+    // OSC address this control is sent to as a float ("/pad/x"), when the profile has an oscTarget.
+    // A mapping with no MIDI message type sends OSC only.
+    std::string oscAddress;
+};
+
+// One .hidmidi.json profile: a device, the MIDI port it sends to, and any number of mappings.
+struct MidiMappingConfig {
+    std::string hidDevicePath;
+    std::string hidDeviceName;
+    std::string midiDeviceName;
+    // Further ports that receive the same output, each through its own queue and output thread.
+    // They use the same backend as midiDeviceName; for RAW_MIDI they name raw devices.
+    std::vector<std::string> midiExtraDeviceNames;
+    int midiBytesPerSecond = 0; // output budget for slow links (3125 for 5-pin DIN); 0 is unlimited
+    // Linux can bypass RtMidi and write sequencer events itself, either one syscall per message
+    // or buffered and drained once per input frame. RAW_MIDI skips the sequencer and writes bytes
+    // to midiRawDevice: an ALSA rawmidi name ("hw:1,0,0") or a file, FIFO or /dev/midi* path.
+    enum class MidiBackend { RTMIDI, ALSA_SEQ, ALSA_SEQ_BUFFERED, RAW_MIDI } midiBackend = MidiBackend::RTMIDI;
+    std::string midiRawDevice;
+    bool midiRunningStatus = true; // RAW_MIDI: omit repeated status bytes
+    // Create our own output port for other clients to subscribe to, instead of connecting to
+    // midiDeviceName (RtMidi and ALSA sequencer backends).
+    bool midiVirtualPort = false;
+    std::string midiVirtualPortName = DEFAULT_VIRTUAL_PORT_NAME;
+    // What the output thread's queue does when full, per message class. Coalesce keeps the newest
+    // value per controller and only applies to streams; urgent messages treat it as Block.
+    enum class OutputQueuePolicy { DROP, COALESCE, BLOCK };
+    OutputQueuePolicy urgentOutputPolicy = OutputQueuePolicy::BLOCK;
+    OutputQueuePolicy streamOutputPolicy = OutputQueuePolicy::COALESCE;
+    std::string oscTarget; // "host:port" that receives OSC over UDP; empty sends no OSC
+    std::vector<ControlMapping> mappings;
+};
+
+// --- JSON Serialization ---
+NLOHMANN_JSON_SERIALIZE_ENUM(ControlMapping::MidiMessageType, {
+    {ControlMapping::MidiMessageType::NONE, nullptr},
+    {ControlMapping::MidiMessageType::NOTE_ON_OFF, "NoteOnOff"},
+    {ControlMapping::MidiMessageType::CC, "CC"},
+    {ControlMapping::MidiMessageType::CC_14BIT, "CC14"},
+    {ControlMapping::MidiMessageType::PITCH_BEND, "PitchBend"},
+    {ControlMapping::MidiMessageType::NRPN, "NRPN"},
+    {ControlMapping::MidiMessageType::RPN, "RPN"}
+})
+
+NLOHMANN_JSON_SERIALIZE_ENUM(ControlMapping::ResponseCurve, {
+    {ControlMapping::ResponseCurve::LINEAR, "Linear"},
+    {ControlMapping::ResponseCurve::EXPONENTIAL, "Exponential"},
+    {ControlMapping::ResponseCurve::LOGARITHMIC, "Logarithmic"},
+    {ControlMapping::ResponseCurve::S_CURVE, "SCurve"},
+    {ControlMapping::ResponseCurve::PIECEWISE, "Piecewise"}
+})
+
+NLOHMANN_JSON_SERIALIZE_ENUM(ControlMapping::AxisFilter, {
+    {ControlMapping::AxisFilter::NONE, "None"},
+    {ControlMapping::AxisFilter::EMA, "EMA"},
+    {ControlMapping::AxisFilter::ONE_EURO, "OneEuro"}
+})
+
+NLOHMANN_JSON_SERIALIZE_ENUM(ControlMapping::AxisQueuePolicy, {
+    {ControlMapping::AxisQueuePolicy::COALESCE, "Coalesce"},
+    {ControlMapping::AxisQueuePolicy::QUEUE_ALL, "QueueAll"}
+})
+
+NLOHMANN_JSON_SERIALIZE_ENUM(MidiMappingConfig::OutputQueuePolicy, {
+    {MidiMappingConfig::OutputQueuePolicy::BLOCK, "Block"},
+    {MidiMappingConfig::OutputQueuePolicy::DROP, "Drop"},
+    {MidiMappingConfig::OutputQueuePolicy::COALESCE, "Coalesce"}
+})
+
+NLOHMANN_JSON_SERIALIZE_ENUM(MidiMappingConfig::MidiBackend, {
+    {MidiMappingConfig::MidiBackend::RTMIDI, "RtMidi"},
+    {MidiMappingConfig::MidiBackend::ALSA_SEQ, "AlsaSeq"},
+    {MidiMappingConfig::MidiBackend::ALSA_SEQ_BUFFERED, "AlsaSeqBuffered"},
+    {MidiMappingConfig::MidiBackend::RAW_MIDI, "RawMidi"}
+})
+
+void to_json(json& j, const ControlInfo& ctrl) {
+    j = json{
+        {"isButton", ctrl.isButton}, {"logicalMin", ctrl.logicalMin},
+        {"logicalMax", ctrl.logicalMax}, {"name", ctrl.name}
+    };
+#ifdef _WIN32
+    j["usagePage"] = ctrl.usagePage;
+    j["usage"] = ctrl.usage;
+#else
+    j["eventType"] = ctrl.eventType;
+    j["eventCode"] = ctrl.eventCode;
+#endif
+}
+
+void from_json(const json& j, ControlInfo& ctrl) {
+    j.at("isButton").get_to(ctrl.isButton);
+    j.at("logicalMin").get_to(ctrl.logicalMin);
+    j.at("logicalMax").get_to(ctrl.logicalMax);
+    j.at("name").get_to(ctrl.name);
+#ifdef _WIN32
+    ctrl.usagePage = j.value("usagePage", 0);
+    ctrl.usage = j.value("usage", 0);
+#else
+    ctrl.eventType = j.value("eventType", 0);
+    ctrl.eventCode = j.value("eventCode", 0);
+#endif
+}
+
+void to_json(json& j, const ControlMapping& map) {
+    j = json{
+        {"control", map.control},
+        {"midiMessageType", map.midiMessageType}, {"midiChannel", map.midiChannel},
+        {"midiNoteOrCCNumber", map.midiNoteOrCCNumber}, {"midiValueNoteOnVelocity", map.midiValueNoteOnVelocity},
+        {"midiValueCCOn", map.midiValueCCOn}, {"midiValueCCOff", map.midiValueCCOff},
+        {"calibrationMinHid", map.calibrationMinHid}, {"calibrationMaxHid", map.calibrationMaxHid},
+        {"calibrationDone", map.calibrationDone}, {"reverseAxis", map.reverseAxis},
+        {"midiSendIntervalMs", map.midiSendIntervalMs}, {"axisQueuePolicy", map.axisQueuePolicy},
+        {"centerDeadzone", map.centerDeadzone}, {"edgeDeadzone", map.edgeDeadzone},
+        {"stepHysteresis", map.stepHysteresis}, {"responseCurve", map.responseCurve},
+        {"curveAmount", map.curveAmount}, {"curvePoints", map.curvePoints}, {"axisFilter", map.axisFilter},
+        {"filterCutoffHz", map.filterCutoffHz}, {"filterBeta", map.filterBeta},
+        {"filterDerivativeCutoffHz", map.filterDerivativeCutoffHz}, {"midiPorts", map.midiPorts},
+        {"oscAddress", map.oscAddress}
+    };
+}
+
+void from_json(const json& j, ControlMapping& map) {
+    j.at("control").get_to(map.control);
+    j.at("midiMessageType").get_to(map.midiMessageType);
+    j.at("midiChannel").get_to(map.midiChannel);
+    j.at("midiNoteOrCCNumber").get_to(map.midiNoteOrCCNumber);
+    map.midiValueNoteOnVelocity = j.value("midiValueNoteOnVelocity", 64);
+    map.midiValueCCOn = j.value("midiValueCCOn", 127);
+    map.midiValueCCOff = j.value("midiValueCCOff", 0);
+    map.calibrationMinHid = j.value("calibrationMinHid", 0);
+    map.calibrationMaxHid = j.value("calibrationMaxHid", 0);
+    map.calibrationDone = j.value("calibrationDone", false);
+    map.reverseAxis = j.value("reverseAxis", false);
+    map.midiSendIntervalMs = j.value("midiSendIntervalMs", 1);
+    map.axisQueuePolicy = j.value("axisQueuePolicy", ControlMapping::AxisQueuePolicy::COALESCE);
+    map.centerDeadzone = j.value("centerDeadzone", 0.0);
+    map.edgeDeadzone = j.value("edgeDeadzone", 0.0);
+    map.stepHysteresis = j.value("stepHysteresis", 0.0);
+    map.responseCurve = j.value("responseCurve", ControlMapping::ResponseCurve::LINEAR);
+    map.curveAmount = j.value("curveAmount", 2.0);
+    map.curvePoints = j.value("curvePoints", std::vector<std::pair<double, double>>());
+    map.axisFilter = j.value("axisFilter", ControlMapping::AxisFilter::NONE);
+    map.filterCutoffHz = j.value("filterCutoffHz", 1.0);
+    map.filterBeta = j.value("filterBeta", 5.0);
+    map.filterDerivativeCutoffHz = j.value("filterDerivativeCutoffHz", 1.0);
+    map.midiPorts = j.value("midiPorts", std::vector<int>());
+    map.oscAddress = j.value("oscAddress", std::string());
+}
+
+void to_json(json& j, const MidiMappingConfig& cfg) {
+    j = json{
+        {"hidDevicePath", cfg.hidDevicePath}, {"hidDeviceName", cfg.hidDeviceName},
+        {"midiDeviceName", cfg.midiDeviceName}, {"midiExtraDeviceNames", cfg.midiExtraDeviceNames},
+        {"midiBytesPerSecond", cfg.midiBytesPerSecond},
+        {"urgentOutputPolicy", cfg.urgentOutputPolicy}, {"streamOutputPolicy", cfg.streamOutputPolicy},
+        {"midiBackend", cfg.midiBackend}, {"midiRawDevice", cfg.midiRawDevice},
+        {"midiRunningStatus", cfg.midiRunningStatus}, {"midiVirtualPort", cfg.midiVirtualPort},
+        {"midiVirtualPortName", cfg.midiVirtualPortName}, {"oscTarget", cfg.oscTarget}, {"mappings", cfg.mappings}
+    };
+}
+
+void from_json(const json& j, MidiMappingConfig& cfg) {
+    j.at("hidDevicePath").get_to(cfg.hidDevicePath);
+    j.at("hidDeviceName").get_to(cfg.hidDeviceName);
+    j.at("midiDeviceName").get_to(cfg.midiDeviceName);
+    cfg.midiExtraDeviceNames = j.value("midiExtraDeviceNames", std::vector<std::string>());
+    cfg.midiBytesPerSecond = j.value("midiBytesPerSecond", 0);
+    cfg.urgentOutputPolicy = j.value("urgentOutputPolicy", MidiMappingConfig::OutputQueuePolicy::BLOCK);
+    cfg.streamOutputPolicy = j.value("streamOutputPolicy", MidiMappingConfig::OutputQueuePolicy::COALESCE);
+    cfg.midiBackend = j.value("midiBackend", MidiMappingConfig::MidiBackend::RTMIDI);
+    cfg.midiRawDevice = j.value("midiRawDevice", std::string());
+    cfg.midiRunningStatus = j.value("midiRunningStatus", true);
+    cfg.midiVirtualPort = j.value("midiVirtualPort", false);
+    cfg.midiVirtualPortName = j.value("midiVirtualPortName", DEFAULT_VIRTUAL_PORT_NAME);
+    cfg.oscTarget = j.value("oscTarget", std::string());
+    if (j.contains("mappings")) {
+        j.at("mappings").get_to(cfg.mappings);
+    } else {
+        // Single-mapping files keep the mapping fields at the top level.
+        cfg.mappings = {j.get<ControlMapping>()};
+    }
+}
+
+// --- Input Event Queue ---
+// Timestamped input handed from the input thread to the dispatch loop. Unlike a single
+// latest-value slot, every button edge survives even when press and release both land
+// between two dispatch passes.
+constexpr size_t CACHE_LINE_SIZE = 64;
+constexpr size_t INPUT_QUEUE_CAPACITY = 1024;
+constexpr size_t INPUT_BACKLOG_CAPACITY = 4096; // events parked while the ring is full
+
+enum InputEventFlags : uint8_t {
+    INPUT_EVENT_BUTTON = 1 << 0,
+    INPUT_EVENT_QUEUE_ALL = 1 << 1, // an axis whose mapping keeps every value (QueueAll)
+};
+
+inline uint8_t InputEventFlagsFor(const ControlMapping& mapping) {
+    if (mapping.control.isButton) return INPUT_EVENT_BUTTON;
+    return mapping.axisQueuePolicy == ControlMapping::AxisQueuePolicy::QUEUE_ALL ? INPUT_EVENT_QUEUE_ALL : 0;
+}
+
+struct InputEvent {
+    uint64_t timestampUs = 0;
+    LONG value = 0;
+    uint16_t mapping = 0;
+    uint16_t device = 0;
+    uint8_t flags = 0;
+};
+
+template <typename T, size_t Capacity>
+class SpscRing {
+    static_assert((Capacity & (Capacity - 1)) == 0, "SpscRing capacity must be a power of two");
+public:
+    // Producer thread only.
+    bool TryPush(const T& item) {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - cachedHead_ == Capacity) {
+            cachedHead_ = head_.load(std::memory_order_acquire);
+            if (tail - cachedHead_ == Capacity) return false;
+        }
+        slots_[tail & (Capacity - 1)] = item;
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer thread only.
+    bool TryPop(T& item) {
+        size_t head = head_.load(std::memory_order_relaxed);
+        if (head == cachedTail_) {
+            cachedTail_ = tail_.load(std::memory_order_acquire);
+            if (head == cachedTail_) return false;
+        }
+        item = slots_[head & (Capacity - 1)];
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    size_t Size() const {
+        return tail_.load(std::memory_order_acquire) - head_.load(std::memory_order_acquire);
+    }
+
+private:
+    // Producer and consumer indices sit on separate cache lines so the threads never false-share;
+    // each side also caches the other's index and only re-reads it when the ring looks full/empty.
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> tail_{0};
+    size_t cachedHead_ = 0;
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> head_{0};
+    size_t cachedTail_ = 0;
+    alignas(CACHE_LINE_SIZE) T slots_[Capacity];
+};
+
+// Producer-side wrapper around the ring. When the dispatcher falls behind, events are parked in
+// a fixed backlog, in order. A Coalesce axis keeps only its newest parked value, which moves
+// behind anything parked since; button edges and QueueAll axes keep every event. Only a full
+// backlog drops events.
+class InputEventQueue {
+public:
+    std::atomic<uint64_t> pushed{0};
+    std::atomic<uint64_t> overflowed{0};
+    std::atomic<uint64_t> coalesced{0};
+    std::atomic<uint64_t> dropped{0}; // lost because the backlog was full too
+    std::atomic<size_t> maxDepth{0};
+
+    void Push(const InputEvent& ev) {
+        pushed.fetch_add(1, std::memory_order_relaxed);
+        // Anything parked must go first to keep edges in order.
+        if (!Flush() || !ring_.TryPush(ev)) {
+            Park(ev);
+            return;
+        }
+        size_t depth = ring_.Size();
+        if (depth > maxDepth.load(std::memory_order_relaxed)) maxDepth.store(depth, std::memory_order_relaxed);
+    }
+
+    // Moves parked events into the ring. Returns true once nothing is left parked.
+    bool Flush() {
+        while (backlogHead_ < backlogEnd_) {
+            if (!ring_.TryPush(backlog_[backlogHead_])) return false;
+            backlogHead_++;
+        }
+        backlogHead_ = backlogEnd_ = 0;
+        return true;
+    }
+
+    bool HasBacklog() const { return backlogHead_ < backlogEnd_; }
+
+    bool Empty() const { return ring_.Size() == 0; }
+
+    bool TryPop(InputEvent& ev) { return ring_.TryPop(ev); }
+
+private:
+    void Park(const InputEvent& ev) {
+        overflowed.fetch_add(1, std::memory_order_relaxed);
+        auto begin = backlog_.begin() + backlogHead_;
+        auto end = backlog_.begin() + backlogEnd_;
+        if (!(ev.flags & (INPUT_EVENT_BUTTON | INPUT_EVENT_QUEUE_ALL))) {
+            auto old = std::find_if(begin, end, [&](const InputEvent& parked) { return parked.mapping == ev.mapping; });
+            if (old != end) {
+                std::move(old + 1, end, old);
+                backlogEnd_--;
+                coalesced.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+        if (backlogEnd_ == INPUT_BACKLOG_CAPACITY) {
+            if (backlogHead_ == 0) {
+                dropped.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            std::move(begin, end, backlog_.begin());
+            backlogEnd_ -= backlogHead_;
+            backlogHead_ = 0;
+        }
+        backlog_[backlogEnd_++] = ev;
+    }
+
+    SpscRing<InputEvent, INPUT_QUEUE_CAPACITY> ring_;
+    // Producer only: parked events are backlog_[backlogHead_, backlogEnd_).
+    std::array<InputEvent, INPUT_BACKLOG_CAPACITY> backlog_;
+    size_t backlogHead_ = 0;
+    size_t backlogEnd_ = 0;
+};
+
+// --- Dispatch Wakeup ---
+// Lets the dispatch loop block until the input thread has queued something. The producer
+// only pays for a syscall when the consumer is actually asleep (or about to be).
+class WakeSignal {
+public:
+    WakeSignal() {
+#ifndef _WIN32
+        fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+#endif
+    }
+    ~WakeSignal() {
+#ifndef _WIN32
+        if (fd_ >= 0) close(fd_);
+#endif
+    }
+    WakeSignal(const WakeSignal&) = delete;
+    WakeSignal& operator=(const WakeSignal&) = delete;
+
+    // Producer side, after publishing work.
+    void Notify() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (waiting_.exchange(false)) Signal();
+    }
+
+    // Consumer side: announce the intent to sleep, then re-check for work before blocking.
+    void Arm() {
+        waiting_.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+
+    // Consumer side, after waking for any reason.
+    void Disarm() {
+        if (waiting_.exchange(false)) return;
+#ifndef _WIN32
+        uint64_t count;
+        while (read(fd_, &count, sizeof(count)) == sizeof(count)) {}
+#else
+        std::lock_guard<std::mutex> lock(mutex_);
+        signaled_ = false;
+#endif
+    }
+
+#ifndef _WIN32
+    int Fd() const { return fd_; }
+#else
+    void WaitUntil(std::chrono::steady_clock::time_point deadline) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (deadline == std::chrono::steady_clock::time_point::max()) cv_.wait(lock, [this] { return signaled_; });
+        else cv_.wait_until(lock, deadline, [this] { return signaled_; });
+        signaled_ = false;
+    }
+#endif
+
+private:
+    void Signal() {
+#ifndef _WIN32
+        uint64_t one = 1;
+        ssize_t written = write(fd_, &one, sizeof(one));
+        (void)written;
+#else
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            signaled_ = true;
+        }
+        cv_.notify_one();
+#endif
+    }
+
+    std::atomic<bool> waiting_{false};
+#ifndef _WIN32
+    int fd_ = -1;
+#else
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool signaled_ = false;
+#endif
+};
+
+// --- Axis Scaling ---
+// Calibrated HID value -> MIDI value. For ranges up to 16 bits the whole mapping, including
+// clamping, deadzones, reversal, the response curve and output resolution, is baked into a
+// table when monitoring starts, so the per-event cost is one clamped index and one load however
+// complex the curve. Wider ranges compute the same function per event; the linear curve uses
+// exact integer rounding.
+//
+// The table holds the position in 1/256ths of an output step rather than the rounded value,
+// so the dispatcher can apply step hysteresis without a second lookup.
+class AxisScaler {
+public:
+    static constexpr size_t MAX_TABLE_ENTRIES = 1 << 16;
+    static constexpr int FRACTION_BITS = 8;
+    static constexpr int HALF_STEP = 1 << (FRACTION_BITS - 1);
+
+    void Build(const ControlMapping& mapping, int outputMax) {
+        table_.clear();
+        ready_ = mapping.calibrationDone && mapping.calibrationMaxHid > mapping.calibrationMinHid;
+        if (!ready_) return;
+        min_ = mapping.calibrationMinHid;
+        max_ = mapping.calibrationMaxHid;
+        reverse_ = mapping.reverseAxis;
+        outputMax_ = outputMax;
+        curve_ = mapping.responseCurve;
+        curveAmount_ = std::max(0.01, mapping.curveAmount);
+        curvePoints_.clear();
+        for (const auto& point : mapping.curvePoints) {
+            curvePoints_.emplace_back(std::max(0.0, std::min(1.0, point.first)), std::max(0.0, std::min(1.0, point.second)));
+        }
+        std::sort(curvePoints_.begin(), curvePoints_.end());
+        if (curve_ == ControlMapping::ResponseCurve::PIECEWISE && curvePoints_.empty()) curve_ = ControlMapping::ResponseCurve::LINEAR;
+
+        // Deadzones are fractions of the calibrated range. The edge deadzone trims both ends;
+        // the center deadzone is a band around the middle that reads as exactly centered.
+        int64_t range = static_cast<int64_t>(max_) - min_;
+        double edge = std::max(0.0, std::min(0.49, mapping.edgeDeadzone));
+        int64_t edgeWidth = static_cast<int64_t>(edge * static_cast<double>(range));
+        low_ = static_cast<LONG>(min_ + edgeWidth);
+        high_ = static_cast<LONG>(max_ - edgeWidth);
+        int64_t live = static_cast<int64_t>(high_) - low_;
+        double center = std::max(0.0, std::min(1.0, mapping.centerDeadzone));
+        int64_t halfBand = std::min<int64_t>(static_cast<int64_t>(center * static_cast<double>(range) / 2), (live - 1) / 2);
+        LONG middle = static_cast<LONG>(low_ + live / 2);
+        centerLow_ = static_cast<LONG>(middle - halfBand);
+        centerHigh_ = static_cast<LONG>(middle + halfBand);
+        hasDeadzones_ = edgeWidth > 0 || halfBand > 0;
+        // The band reads as the curve's middle, so its edges line up with the values around it.
+        // Pitch bend keeps the exact 8192 its receivers treat as no bend.
+        if (curve_ == ControlMapping::ResponseCurve::LINEAR || mapping.midiMessageType == ControlMapping::MidiMessageType::PITCH_BEND) {
+            centerPosition_ = ((outputMax_ + 1) / 2) << FRACTION_BITS;
+        } else {
+            centerPosition_ = static_cast<int>(std::floor(std::max(0.0, std::min(1.0, ApplyCurve(0.5))) * (outputMax_ << FRACTION_BITS)));
+        }
+
+        // Cover the control's whole logical range too, so out-of-calibration values need no clamp branch.
+        int64_t first = std::min<int64_t>(min_, mapping.control.logicalMin);
+        int64_t last = std::max<int64_t>(max_, mapping.control.logicalMax);
+        if (last - first + 1 > static_cast<int64_t>(MAX_TABLE_ENTRIES)) return;
+        base_ = static_cast<LONG>(first);
+        table_.resize(static_cast<size_t>(last - first + 1));
+        for (size_t i = 0; i < table_.size(); ++i) {
+            table_[i] = static_cast<uint32_t>(Compute(static_cast<LONG>(first + static_cast<int64_t>(i))));
+        }
+    }
+
+    bool Ready() const { return ready_; }
+    bool HasTable() const { return !table_.empty(); }
+
+    // Position in 1/256ths of an output step.
+    int Position(LONG value) const {
+        if (!table_.empty()) {
+            int64_t index = std::max<int64_t>(0, std::min<int64_t>(static_cast<int64_t>(table_.size()) - 1, static_cast<int64_t>(value) - base_));
+            return static_cast<int>(table_[static_cast<size_t>(index)]);
+        }
+        return Compute(value);
+    }
+
+    // Rounded output value for a position; the position is floored, so this equals round(norm * outputMax).
+    static int Output(int position) { return (position + HALF_STEP) >> FRACTION_BITS; }
+
+    int Scale(LONG value) const { return Output(Position(value)); }
+
+    // True when the value lies in an edge or center deadzone. Only used for statistics.
+    bool InDeadzone(LONG value) const {
+        return hasDeadzones_ && (value <= low_ || value >= high_ || (value > centerLow_ && value < centerHigh_));
+    }
+
+    // floor(norm * outputMax * 256), where norm = (clamped - low) / (high - low) with the center
+    // band cut out, in exact integer math. The band itself reads as the center output (64, or
+    // 8192 for pitch bend; the curve's middle for a non-linear curve).
+    int Compute(LONG value) const {
+        int64_t band = static_cast<int64_t>(centerHigh_) - centerLow_;
+        int64_t range = static_cast<int64_t>(high_) - low_ - band;
+        LONG clamped = std::max(low_, std::min(high_, value));
+        int64_t offset;
+        if (clamped <= centerLow_) offset = static_cast<int64_t>(clamped) - low_;
+        else if (clamped >= centerHigh_) offset = static_cast<int64_t>(clamped) - low_ - band;
+        else return centerPosition_;
+        if (reverse_) offset = range - offset;
+        if (curve_ == ControlMapping::ResponseCurve::LINEAR) {
+            return static_cast<int>((offset * outputMax_ << FRACTION_BITS) / range);
+        }
+        double shaped = std::max(0.0, std::min(1.0, ApplyCurve(static_cast<double>(offset) / static_cast<double>(range))));
+        return static_cast<int>(std::floor(shaped * (outputMax_ << FRACTION_BITS)));
+    }
+
+    // Maps a normalized position in 0-1 onto 0-1. The built-in curves keep both end points.
+    double ApplyCurve(double x) const {
+        const double a = curveAmount_;
+        switch (curve_) {
+        case ControlMapping::ResponseCurve::EXPONENTIAL:
+            return std::expm1(a * x) / std::expm1(a);
+        case ControlMapping::ResponseCurve::LOGARITHMIC:
+            return std::log1p(std::expm1(a) * x) / a;
+        case ControlMapping::ResponseCurve::S_CURVE: {
+            double rising = std::pow(x, a);
+            return rising / (rising + std::pow(1.0 - x, a));
+        }
+        case ControlMapping::ResponseCurve::PIECEWISE: {
+            if (x <= curvePoints_.front().first) return curvePoints_.front().second;
+            for (size_t i = 1; i < curvePoints_.size(); ++i) {
+                const auto& p0 = curvePoints_[i - 1];
+                const auto& p1 = curvePoints_[i];
+                if (x <= p1.first) {
+                    double span = p1.first - p0.first;
+                    return span > 0.0 ? p0.second + (p1.second - p0.second) * (x - p0.first) / span : p1.second;
+                }
+            }
+            return curvePoints_.back().second;
+        }
+        default:
+            return x;
+        }
+    }
+
+private:
+    std::vector<uint32_t> table_;
+    LONG base_ = 0;
+    LONG min_ = 0;
+    LONG max_ = 0;
+    LONG low_ = 0;        // calibrated range minus the edge deadzone
+    LONG high_ = 0;
+    LONG centerLow_ = 0;  // center deadzone band; empty when both are equal
+    LONG centerHigh_ = 0;
+    int centerPosition_ = 0; // what the center band reads as
+    bool hasDeadzones_ = false;
+    bool reverse_ = false;
+    bool ready_ = false;
+    int outputMax_ = 127;
+    ControlMapping::ResponseCurve curve_ = ControlMapping::ResponseCurve::LINEAR;
+    double curveAmount_ = 2.0;
+    std::vector<std::pair<double, double>> curvePoints_;
+};
+
+// --- Axis Filtering ---
+// Smooths raw axis values before scaling, using the event timestamps so the result does not
+// depend on how often the device reports. EMA is a fixed first-order low-pass; One Euro raises
+// the cutoff with the stick's speed, so it smooths hard at rest and adds little lag in motion.
+class AxisFilter {
+public:
+    void Configure(const ControlMapping& mapping) {
+        type_ = mapping.axisFilter;
+        cutoffHz_ = std::max(0.01, mapping.filterCutoffHz);
+        beta_ = std::max(0.0, mapping.filterBeta);
+        derivativeCutoffHz_ = std::max(0.01, mapping.filterDerivativeCutoffHz);
+        range_ = std::max(1.0, static_cast<double>(mapping.calibrationMaxHid) - mapping.calibrationMinHid);
+        primed_ = false;
+    }
+
+    bool Enabled() const { return type_ != ControlMapping::AxisFilter::NONE; }
+    uint64_t LastUs() const { return lastUs_; }
+
+    LONG Apply(LONG raw, uint64_t timestampUs) {
+        double x = static_cast<double>(raw);
+        // Timestamps from different reads can arrive slightly out of order; those count as no
+        // time passing. Only a clock that jumped back a long way starts the filter over.
+        if (!primed_ || timestampUs + RESET_GAP_US < lastUs_) {
+            primed_ = true;
+            value_ = x;
+            speed_ = 0.0;
+            lastUs_ = timestampUs;
+            return raw;
+        }
+        uint64_t elapsedUs = timestampUs > lastUs_ ? timestampUs - lastUs_ : 0;
+        // Two changes in one report share a timestamp; treat them as 1 ms apart.
+        double dt = std::max(0.001, static_cast<double>(elapsedUs) * 1e-6);
+        lastUs_ = std::max(lastUs_, timestampUs);
+
+        double cutoff = cutoffHz_;
+        if (type_ == ControlMapping::AxisFilter::ONE_EURO) {
+            double speed = (x - value_) / range_ / dt;
+            speed_ += Alpha(derivativeCutoffHz_, dt) * (speed - speed_);
+            cutoff += beta_ * std::abs(speed_);
+        }
+        value_ += Alpha(cutoff, dt) * (x - value_);
+        return static_cast<LONG>(std::lround(value_));
+    }
+
+private:
+    static constexpr uint64_t RESET_GAP_US = 1000000;
+
+    static double Alpha(double cutoffHz, double dt) {
+        double tau = 1.0 / (2.0 * 3.14159265358979323846 * cutoffHz);
+        return 1.0 / (1.0 + tau / dt);
+    }
+
+    ControlMapping::AxisFilter type_ = ControlMapping::AxisFilter::NONE;
+    double cutoffHz_ = 1.0;
+    double beta_ = 0.0;
+    double derivativeCutoffHz_ = 1.0;
+    double range_ = 1.0;
+    bool primed_ = false;
+    double value_ = 0.0;
+    double speed_ = 0.0; // smoothed, in calibrated ranges per second
+    uint64_t lastUs_ = 0;
+};
+
+// --- MIDI Output ---
+// Messages are encoded once per mapping when monitoring starts and sent from fixed buffers,
+// so the send path never touches the heap.
+struct MidiMessage {
+    unsigned char bytes[3] = {0, 0, 0};
+    uint8_t size = 0;
+};
+
+inline MidiMessage MakeMidiMessage(int status, int data1, int data2) {
+    MidiMessage message;
+    message.bytes[0] = static_cast<unsigned char>(status);
+    message.bytes[1] = static_cast<unsigned char>(data1 & 0x7F);
+    message.bytes[2] = static_cast<unsigned char>(data2 & 0x7F);
+    message.size = 3;
+    return message;
+}
+
+// Every message a mapping can produce, built from its channel, number and values.
+struct EncodedMapping {
+    enum class AxisFormat { CC7, CC14, PITCH_BEND, PARAMETER } axisFormat = AxisFormat::CC7;
+    int outputMax = 127;                 // highest axis value
+    int channel = 0;
+    MidiMessage pressed;
+    MidiMessage released;
+    std::array<MidiMessage, 128> values; // axis output (the MSB for CC14 and PARAMETER), indexed by the 7-bit value
+    std::array<MidiMessage, 128> lsbValues; // CC14 and PARAMETER: the LSB, indexed by the low 7 bits
+    MidiMessage pitchBend;               // PITCH_BEND only: status byte; the value is patched in per send
+    // PARAMETER (NRPN/RPN) only: the CC 99/98 or 101/100 pair that selects the parameter, and a key
+    // identifying it in g_selectedParameter.
+    MidiMessage selectMsb;
+    MidiMessage selectLsb;
+    int parameterKey = -1;
+};
+
+class MidiOutput {
+public:
+    virtual ~MidiOutput() = default;
+    virtual void Send(const unsigned char* bytes, size_t size) = 0;
+    // Notes and button presses: never held back behind continuous controller streams.
+    virtual void SendUrgent(const unsigned char* bytes, size_t size) { Send(bytes, size); }
+    // Called once the messages for an input frame (or one dispatcher pass) have all been sent.
+    virtual void EndFrame() {}
+    void Send(const MidiMessage& message) { Send(message.bytes, message.size); }
+    void SendUrgent(const MidiMessage& message) { SendUrgent(message.bytes, message.size); }
+};
+
+// Identifies a continuous stream, where only the latest value matters: a CC (other than the
+// NRPN/RPN select and data entry controllers) or pitch bend, per channel. -1 for anything else.
+constexpr size_t MIDI_STREAM_KEY_COUNT = 16 * 128 + 16;
+
+inline int MidiStreamKey(const unsigned char* bytes, size_t size) {
+    if (size != 3) return -1;
+    int channel = bytes[0] & 0x0F;
+    switch (bytes[0] & 0xF0) {
+    case 0xB0:
+        switch (bytes[1]) {
+        case 6: case 38: case 96: case 97: case 98: case 99: case 100: case 101:
+            return -1;
+        default:
+            return channel * 128 + bytes[1];
+        }
+    case 0xE0:
+        return 16 * 128 + channel;
+    default:
+        return -1;
+    }
+}
+
+// For the LSB of a 14-bit CC pair (CC 32-63), the stream key of its MSB; -1 for anything else.
+// Receivers clear the LSB when the MSB arrives, so a queued MSB must go out before its LSB.
+inline int MidiStreamMsbKey(int key) {
+    int controller = key % 128;
+    return key < 16 * 128 && controller >= 32 && controller < 64 ? key - 32 : -1;
+}
+
+class RtMidiOutput : public MidiOutput {
+public:
+    explicit RtMidiOutput(RtMidiOut* port = nullptr) : port_(port) {}
+    void SetPort(RtMidiOut& port) { port_ = &port; }
+    void Send(const unsigned char* bytes, size_t size) override { port_->sendMessage(bytes, size); }
+private:
+    RtMidiOut* port_;
+};
+
+#ifndef _WIN32
+// Native ALSA sequencer output. RtMidi copies every message into a std::vector and re-parses the
+// bytes into a sequencer event. This keeps a complete snd_seq_event_t per status byte, prepared
+// when the port opens, and only writes the message's data bytes into it. Direct mode hands each
+// event to the kernel at once. Buffered mode collects a frame's events in the client's output
+// buffer and drains them with one write at EndFrame().
+class AlsaSeqOutput : public MidiOutput {
+public:
+    ~AlsaSeqOutput() override { Close(); }
+
+    uint64_t unsupported = 0; // messages with no sequencer event equivalent (system messages)
+
+    // Opens a client with one output port and, when destination is not empty, connects it to the
+    // port named there: "client:port", or an RtMidi port name, which ends in that address. With no
+    // destination the port is virtual: other clients subscribe to it by portName.
+    bool Open(const std::string& destination, bool buffered, const std::string& portName = DEFAULT_VIRTUAL_PORT_NAME) {
+        Close();
+        int err = snd_seq_open(&seq_, "default", SND_SEQ_OPEN_OUTPUT, 0);
+        if (err < 0) {
+            seq_ = nullptr;
+            std::cerr << "\nError: Could not open the ALSA sequencer. " << snd_strerror(err) << std::endl;
+            return false;
+        }
+        snd_seq_set_client_name(seq_, DEFAULT_VIRTUAL_PORT_NAME.c_str());
+        port_ = snd_seq_create_simple_port(seq_, portName.c_str(), SND_SEQ_PORT_CAP_READ | SND_SEQ_PORT_CAP_SUBS_READ,
+                                           SND_SEQ_PORT_TYPE_MIDI_GENERIC | SND_SEQ_PORT_TYPE_APPLICATION);
+        if (port_ < 0) {
+            std::cerr << "\nError: Could not create an ALSA sequencer port. " << snd_strerror(port_) << std::endl;
+            Close();
+            return false;
+        }
+        if (!destination.empty()) {
+            std::string address = destination.substr(destination.find_last_of(' ') + 1);
+            snd_seq_addr_t dest;
+            err = snd_seq_parse_address(seq_, &dest, address.c_str());
+            if (err >= 0) err = snd_seq_connect_to(seq_, port_, dest.client, dest.port);
+            if (err < 0) {
+                std::cerr << "\nError: Could not connect to ALSA port '" << destination << "'. " << snd_strerror(err) << std::endl;
+                Close();
+                return false;
+            }
+        }
+        buffered_ = buffered;
+        BuildTemplates();
+        return true;
+    }
+
+    void Close() {
+        if (!seq_) return;
+        if (buffered_) snd_seq_drain_output(seq_);
+        snd_seq_close(seq_);
+        seq_ = nullptr;
+    }
+
+    bool IsOpen() const { return seq_ != nullptr; }
+
+    void Send(const unsigned char* bytes, size_t size) override {
+        if (!seq_) return;
+        Layout layout = size >= 2 ? layouts_[bytes[0]] : Layout::UNSUPPORTED;
+        snd_seq_event_t& event = templates_[bytes[0]];
+        unsigned char data2 = size > 2 ? bytes[2] : 0;
+        switch (layout) {
+        case Layout::NOTE:
+            event.data.note.note = bytes[1];
+            event.data.note.velocity = data2;
+            break;
+        case Layout::CONTROLLER:
+            event.data.control.param = bytes[1];
+            event.data.control.value = data2;
+            break;
+        case Layout::VALUE:
+            event.data.control.value = bytes[1];
+            break;
+        case Layout::PITCH_BEND:
+            event.data.control.value = ((data2 << 7) | bytes[1]) - 8192;
+            break;
+        case Layout::UNSUPPORTED:
+            unsupported++;
+            return;
+        }
+        if (buffered_) {
+            snd_seq_event_output(seq_, &event);
+            pending_ = true;
+        } else {
+            snd_seq_event_output_direct(seq_, &event);
+        }
+    }
+
+    void EndFrame() override {
+        if (!pending_) return;
+        snd_seq_drain_output(seq_);
+        pending_ = false;
+    }
+
+private:
+    // Where a message's data bytes go in its event.
+    enum class Layout : uint8_t { UNSUPPORTED, NOTE, CONTROLLER, VALUE, PITCH_BEND };
+
+    // One complete event per channel voice status byte, with its type, channel, source and
+    // routing already set, so a send only writes the data bytes.
+    void BuildTemplates() {
+        snd_seq_event_t base;
+        snd_seq_ev_clear(&base);
+        snd_seq_ev_set_source(&base, port_);
+        snd_seq_ev_set_subs(&base);
+        snd_seq_ev_set_direct(&base);
+        layouts_.fill(Layout::UNSUPPORTED);
+        for (int status = 0x80; status < 0xF0; ++status) {
+            snd_seq_event_t& event = templates_[status];
+            event = base;
+            unsigned char channel = static_cast<unsigned char>(status & 0x0F);
+            switch (status & 0xF0) {
+            case 0x80:
+            case 0x90:
+            case 0xA0:
+                event.type = (status & 0xF0) == 0x80 ? SND_SEQ_EVENT_NOTEOFF
+                           : (status & 0xF0) == 0x90 ? SND_SEQ_EVENT_NOTEON : SND_SEQ_EVENT_KEYPRESS;
+                event.data.note.channel = channel;
+                layouts_[status] = Layout::NOTE;
+                break;
+            case 0xB0:
+                event.type = SND_SEQ_EVENT_CONTROLLER;
+                event.data.control.channel = channel;
+                layouts_[status] = Layout::CONTROLLER;
+                break;
+            case 0xC0:
+            case 0xD0:
+                event.type = (status & 0xF0) == 0xC0 ? SND_SEQ_EVENT_PGMCHANGE : SND_SEQ_EVENT_CHANPRESS;
+                event.data.control.channel = channel;
+                layouts_[status] = Layout::VALUE;
+                break;
+            case 0xE0:
+                event.type = SND_SEQ_EVENT_PITCHBEND;
+                event.data.control.channel = channel;
+                layouts_[status] = Layout::PITCH_BEND;
+                break;
+            }
+        }
+    }
+
+    snd_seq_t* seq_ = nullptr;
+    int port_ = -1;
+    bool buffered_ = false;
+    bool pending_ = false;
+    std::array<snd_seq_event_t, 256> templates_;
+    std::array<Layout, 256> layouts_;
+};
+
+// Writes MIDI bytes straight to hardware, with no sequencer in between: an ALSA rawmidi device,
+// or any file descriptor (a /dev/midi* node, a FIFO, a file). A frame's bytes are collected and
+// written with one call at EndFrame(). With running status, a channel message whose status byte
+// matches the previous one is sent without it, which saves a third of a steady CC stream.
+class RawMidiOutput : public MidiOutput {
+public:
+    ~RawMidiOutput() override { Close(); }
+
+    uint64_t messages = 0;
+    uint64_t bytesWritten = 0;
+    uint64_t statusBytesSkipped = 0; // saved by running status
+    uint64_t writeErrors = 0;
+
+    // target is an ALSA rawmidi name ("hw:..." or "default") or a path, which is opened for appending.
+    // Opening never blocks, so a busy device or a FIFO nobody reads fails at startup instead of
+    // hanging it; writes then block, which is why this backend always runs behind the output thread.
+    bool Open(const std::string& target, bool runningStatus) {
+        Close();
+        runningStatus_ = runningStatus;
+        lastStatus_ = 0;
+        if (target.compare(0, 3, "hw:") == 0 || target == "default" || target.compare(0, 7, "virtual") == 0) {
+            int err = snd_rawmidi_open(nullptr, &rawmidi_, target.c_str(), SND_RAWMIDI_NONBLOCK);
+            if (err >= 0) err = snd_rawmidi_nonblock(rawmidi_, 0);
+            if (err < 0) {
+                if (rawmidi_) snd_rawmidi_close(rawmidi_);
+                rawmidi_ = nullptr;
+                std::cerr << "\nError: Could not open raw MIDI device '" << target << "'. " << snd_strerror(err) << std::endl;
+                return false;
+            }
+            return true;
+        }
+        fd_ = open(target.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC | O_NONBLOCK, 0644);
+        if (fd_ < 0) {
+            int error = errno;
+            std::cerr << "\nError: Could not open MIDI output '" << target << "'. " << strerror(error);
+            if (error == ENXIO) std::cerr << " (a FIFO needs a reader before it can be opened)";
+            std::cerr << std::endl;
+            return false;
+        }
+        int flags = fcntl(fd_, F_GETFL);
+        if (flags < 0 || fcntl(fd_, F_SETFL, flags & ~O_NONBLOCK) < 0) {
+            std::cerr << "\nError: Could not configure MIDI output '" << target << "'. " << strerror(errno) << std::endl;
+            close(fd_);
+            fd_ = -1;
+            return false;
+        }
+        return true;
+    }
+
+    void Close() {
+        Flush();
+        if (rawmidi_) {
+            snd_rawmidi_drain(rawmidi_);
+            snd_rawmidi_close(rawmidi_);
+            rawmidi_ = nullptr;
+        }
+        if (fd_ >= 0) {
+            close(fd_);
+            fd_ = -1;
+        }
+    }
+
+    bool IsOpen() const { return rawmidi_ || fd_ >= 0; }
+
+    void Send(const unsigned char* bytes, size_t size) override {
+        if (size == 0 || !IsOpen()) return;
+        if (used_ + size > buffer_.size()) Flush();
+        messages++;
+        unsigned char status = bytes[0];
+        if (status >= 0xF8) {
+            // Real-time messages may go anywhere and leave running status alone.
+        } else if (status >= 0xF0) {
+            lastStatus_ = 0; // system common and SysEx cancel running status
+        } else if (runningStatus_ && status == lastStatus_) {
+            bytes++;
+            size--;
+            statusBytesSkipped++;
+        } else {
+            lastStatus_ = status;
+        }
+        std::copy(bytes, bytes + size, buffer_.begin() + used_);
+        used_ += size;
+    }
+
+    void EndFrame() override { Flush(); }
+
+private:
+    void Flush() {
+        if (used_ == 0) return;
+        ssize_t written = rawmidi_ ? snd_rawmidi_write(rawmidi_, buffer_.data(), used_) : write(fd_, buffer_.data(), used_);
+        if (written == static_cast<ssize_t>(used_)) {
+            bytesWritten += used_;
+        } else {
+            // The receiver may have lost a status byte; the next message must carry one.
+            writeErrors++;
+            lastStatus_ = 0;
+        }
+        used_ = 0;
+    }
+
+    snd_rawmidi_t* rawmidi_ = nullptr;
+    int fd_ = -1;
+    bool runningStatus_ = true;
+    unsigned char lastStatus_ = 0;
+    std::array<unsigned char, 1024> buffer_;
+    size_t used_ = 0;
+};
+#endif
+
+// Discards everything; used by --bench.
+class NullMidiOutput : public MidiOutput {
+public:
+    std::atomic<uint64_t> messages{0}; // may be written by an output thread
+    void Send(const unsigned char*, size_t) override { messages.fetch_add(1, std::memory_order_relaxed); }
+};
+
+// Holds CC and pitch bend messages until the end of the frame and forwards only the last value
+// per (status, controller), in the order each key was first staged, except that a 14-bit MSB
+// always goes just ahead of its LSB. Mappings that share a destination then cost one message per
+// frame. Anything order-sensitive (notes, NRPN/RPN
+// parameter and data entry CCs, system messages) flushes the stage and passes straight through.
+class CoalescingMidiOutput : public MidiOutput {
+public:
+    static constexpr size_t KEY_COUNT = MIDI_STREAM_KEY_COUNT;
+
+    explicit CoalescingMidiOutput(MidiOutput& next) : next_(next) {
+        slotOf_.fill(-1);
+        staged_.reserve(KEY_COUNT);
+    }
+
+    uint64_t staged = 0;    // messages that went through the stage
+    uint64_t collapsed = 0; // staged messages replaced by a later value for the same key
+
+    void Send(const unsigned char* bytes, size_t size) override {
+        int key = MidiStreamKey(bytes, size);
+        if (key < 0) {
+            Flush();
+            next_.Send(bytes, size);
+            return;
+        }
+        staged++;
+        MidiMessage message;
+        std::copy(bytes, bytes + 3, message.bytes);
+        message.size = 3;
+        if (slotOf_[key] >= 0) {
+            staged_[slotOf_[key]] = message;
+            collapsed++;
+        } else {
+            slotOf_[key] = static_cast<int16_t>(staged_.size());
+            stagedKeys_[staged_.size()] = static_cast<uint16_t>(key);
+            staged_.push_back(message);
+        }
+    }
+
+    void SendUrgent(const unsigned char* bytes, size_t size) override {
+        Flush();
+        next_.SendUrgent(bytes, size);
+    }
+
+    void EndFrame() override {
+        Flush();
+        next_.EndFrame();
+    }
+
+private:
+    void Flush() {
+        for (size_t i = 0; i < staged_.size(); ++i) {
+            uint16_t key = stagedKeys_[i];
+            if (slotOf_[key] < 0) continue; // an MSB already sent ahead of its LSB
+            int msb = MidiStreamMsbKey(key);
+            if (msb >= 0 && slotOf_[msb] > static_cast<int16_t>(i)) {
+                next_.Send(staged_[slotOf_[msb]]);
+                slotOf_[msb] = -1;
+            }
+            next_.Send(staged_[i]);
+            slotOf_[key] = -1;
+        }
+        staged_.clear();
+    }
+
+    MidiOutput& next_;
+    std::array<int16_t, KEY_COUNT> slotOf_;
+    std::array<uint16_t, KEY_COUNT> stagedKeys_;
+    std::vector<MidiMessage> staged_;
+};
+
+// How long messages waited in an output stage before being passed on.
+struct OutputDelayStats {
+    uint64_t messages = 0;      // messages passed on
+    uint64_t totalDelayUs = 0;  // summed time between queueing and sending
+    uint64_t maxDelayUs = 0;
+
+    void Record(std::chrono::steady_clock::duration delay) {
+        uint64_t us = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(delay).count());
+        messages++;
+        totalDelayUs += us;
+        maxDelayUs = std::max(maxDelayUs, us);
+    }
+};
+
+// Keeps output within a bytes-per-second budget, for links like 5-pin DIN that carry about a
+// thousand 3-byte messages a second. Urgent messages, and anything order-sensitive, wait in a
+// FIFO lane that is always served first. Continuous streams wait in a second lane that keeps
+// only the newest value per stream and serves the streams round-robin with what is left. A
+// 14-bit CC pair queued together is one stream: its turn sends the MSB and then the LSB.
+// With no budget every message is passed straight through.
+class ScheduledMidiOutput : public MidiOutput {
+public:
+    using Clock = std::chrono::steady_clock;
+    static constexpr size_t PRIORITY_CAPACITY = 256;
+    using LaneStats = OutputDelayStats;
+
+    explicit ScheduledMidiOutput(MidiOutput& next) : next_(next) {
+        queued_.fill(false);
+        withMsb_.fill(false);
+    }
+
+    LaneStats priorityLane;
+    LaneStats streamLane;
+    uint64_t superseded = 0;        // queued stream values replaced by a newer one before sending
+    uint64_t priorityOverflows = 0; // priority messages sent over budget because the lane was full
+
+    void SetBudget(int bytesPerSecond) {
+        bytesPerSecond_ = std::max(0, bytesPerSecond);
+        // Allow a few milliseconds of burst so one frame's messages need not be spread out.
+        burstBytes_ = std::max(3.0, bytesPerSecond_ / 250.0);
+        tokens_ = burstBytes_;
+        refilled_ = Clock::now();
+    }
+
+    int Budget() const { return bytesPerSecond_; }
+
+    void Send(const unsigned char* bytes, size_t size) override {
+        int key = MidiStreamKey(bytes, size);
+        if (key < 0) {
+            SendUrgent(bytes, size);
+            return;
+        }
+        if (bytesPerSecond_ == 0) {
+            next_.Send(bytes, size);
+            return;
+        }
+        auto now = Clock::now();
+        if (queued_[key]) {
+            superseded++;
+        } else {
+            queued_[key] = true;
+            since_[key] = now;
+            int msb = MidiStreamMsbKey(key);
+            int lsb = key + 32;
+            if (msb >= 0 && queued_[msb]) {
+                // An LSB rides along with its queued MSB.
+                withMsb_[key] = true;
+            } else if (MidiStreamMsbKey(lsb) == key && queued_[lsb]) {
+                // The MSB takes its queued LSB's turn, and the LSB follows it there.
+                streamOrder_[slotOf_[lsb]] = static_cast<uint16_t>(key);
+                slotOf_[key] = slotOf_[lsb];
+                withMsb_[lsb] = true;
+            } else {
+                size_t slot = (streamHead_ + streamCount_) % MIDI_STREAM_KEY_COUNT;
+                streamCount_++;
+                streamOrder_[slot] = static_cast<uint16_t>(key);
+                slotOf_[key] = static_cast<uint16_t>(slot);
+            }
+        }
+        std::copy(bytes, bytes + 3, latest_[key].bytes);
+        latest_[key].size = 3;
+        Pump(now);
+    }
+
+    void SendUrgent(const unsigned char* bytes, size_t size) override {
+        if (bytesPerSecond_ == 0 || size > 3) {
+            next_.SendUrgent(bytes, size);
+            return;
+        }
+        auto now = Clock::now();
+        if (priorityCount_ == PRIORITY_CAPACITY) {
+            priorityOverflows++;
+            next_.SendUrgent(bytes, size);
+            return;
+        }
+        Pending& pending = priority_[(priorityHead_ + priorityCount_) % PRIORITY_CAPACITY];
+        std::copy(bytes, bytes + size, pending.message.bytes);
+        pending.message.size = static_cast<uint8_t>(size);
+        pending.since = now;
+        priorityCount_++;
+        Pump(now);
+    }
+
+    void EndFrame() override { next_.EndFrame(); }
+
+    // Sends whatever the budget allows. Returns when the next queued message can go out, or
+    // time_point::max() when both lanes are empty.
+    Clock::time_point Pump(Clock::time_point now) {
+        if (bytesPerSecond_ == 0 || (priorityCount_ == 0 && streamCount_ == 0)) return Clock::time_point::max();
+        double elapsed = std::chrono::duration<double>(now - refilled_).count();
+        tokens_ = std::min(burstBytes_, tokens_ + std::max(0.0, elapsed) * bytesPerSecond_);
+        refilled_ = now;
+
+        while (priorityCount_ > 0 && tokens_ >= priority_[priorityHead_].message.size) {
+            Pending& pending = priority_[priorityHead_];
+            tokens_ -= pending.message.size;
+            priorityLane.Record(now - pending.since);
+            next_.SendUrgent(pending.message);
+            priorityHead_ = (priorityHead_ + 1) % PRIORITY_CAPACITY;
+            priorityCount_--;
+        }
+        while (priorityCount_ == 0 && streamCount_ > 0 && tokens_ >= 3) {
+            uint16_t key = streamOrder_[streamHead_];
+            streamHead_ = (streamHead_ + 1) % MIDI_STREAM_KEY_COUNT;
+            streamCount_--;
+            SendStream(key, now);
+            // The pair's LSB goes out in the same turn, even if that briefly overdraws the budget.
+            uint16_t lsb = key + 32;
+            if (MidiStreamMsbKey(lsb) == key && withMsb_[lsb]) SendStream(lsb, now);
+        }
+
+        if (priorityCount_ == 0 && streamCount_ == 0) return Clock::time_point::max();
+        double needed = (priorityCount_ > 0 ? priority_[priorityHead_].message.size : 3) - tokens_;
+        return now + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(needed / bytesPerSecond_));
+    }
+
+private:
+    struct Pending {
+        MidiMessage message;
+        Clock::time_point since;
+    };
+
+    void SendStream(uint16_t key, Clock::time_point now) {
+        queued_[key] = false;
+        withMsb_[key] = false;
+        tokens_ -= latest_[key].size;
+        streamLane.Record(now - since_[key]);
+        next_.Send(latest_[key]);
+    }
+
+    MidiOutput& next_;
+    int bytesPerSecond_ = 0;
+    double burstBytes_ = 3.0;
+    double tokens_ = 0.0;
+    Clock::time_point refilled_{};
+
+    std::array<Pending, PRIORITY_CAPACITY> priority_;
+    size_t priorityHead_ = 0;
+    size_t priorityCount_ = 0;
+
+    // Each stream is queued at most once, so a ring of every key never overflows.
+    std::array<MidiMessage, MIDI_STREAM_KEY_COUNT> latest_;
+    std::array<Clock::time_point, MIDI_STREAM_KEY_COUNT> since_;
+    std::array<bool, MIDI_STREAM_KEY_COUNT> queued_;
+    std::array<bool, MIDI_STREAM_KEY_COUNT> withMsb_; // a queued LSB that is sent right after its MSB
+    std::array<uint16_t, MIDI_STREAM_KEY_COUNT> streamOrder_;
+    std::array<uint16_t, MIDI_STREAM_KEY_COUNT> slotOf_; // each queued key's place in streamOrder_
+    size_t streamHead_ = 0;
+    size_t streamCount_ = 0;
+};
+
+// Hands preencoded messages to a dedicated output thread, so a slow driver write never stalls
+// the dispatcher. The dispatcher is the only producer: it pushes into a bounded lock-free queue,
+// and when that is full each message class follows its policy. Drop discards the message, Block
+// waits for room, and Coalesce (streams only) parks the newest value per controller for the
+// thread to send after the queue. A 14-bit CC pair is parked together and sent MSB first.
+// Until Start() is called, and after Stop(), messages pass straight through.
+class AsyncMidiOutput : public MidiOutput {
+public:
+    using Clock = std::chrono::steady_clock;
+    using Policy = MidiMappingConfig::OutputQueuePolicy;
+    static constexpr size_t QUEUE_CAPACITY = 1024;
+
+    struct ClassStats {
+        uint64_t queued = 0;
+        uint64_t dropped = 0;
+        uint64_t coalesced = 0;
+        uint64_t blocked = 0; // pushes that had to wait for room
+    };
+
+    explicit AsyncMidiOutput(MidiOutput& next) : next_(&next) {
+        parked_.fill(false);
+        listed_.fill(false);
+    }
+    ~AsyncMidiOutput() override { Stop(); }
+
+    // Written by the producer; read once stopped.
+    ClassStats urgent;
+    ClassStats stream;
+    size_t highWater = 0; // deepest the queue has been
+    OutputDelayStats latency; // queueing to the end of the port write, for messages that went through the queue
+
+    void Start(Policy urgentPolicy, Policy streamPolicy) {
+        if (thread_.joinable()) return;
+        urgentPolicy_ = urgentPolicy == Policy::COALESCE ? Policy::BLOCK : urgentPolicy;
+        streamPolicy_ = streamPolicy;
+        stop_ = false;
+        thread_ = std::thread([this] { Run(); });
+        running_ = true;
+    }
+
+    // Sends everything still queued, then joins the thread.
+    void Stop() {
+        if (!thread_.joinable()) return;
+        running_ = false;
+        stop_ = true;
+        wake_.Notify();
+        thread_.join();
+    }
+
+    bool Running() const { return running_; }
+
+    // Selects the port backend. Only while stopped.
+    void SetNext(MidiOutput& next) { next_ = &next; }
+
+    void Send(const unsigned char* bytes, size_t size) override {
+        int key = MidiStreamKey(bytes, size);
+        // Order-sensitive messages travel with the urgent class so they stay in sequence.
+        Enqueue(bytes, size, key, key < 0);
+    }
+
+    void SendUrgent(const unsigned char* bytes, size_t size) override { Enqueue(bytes, size, -1, true); }
+
+    // One wakeup per frame rather than per message, and none for a frame that sent nothing here.
+    void EndFrame() override {
+        if (!running_) next_->EndFrame();
+        else if (queue_.Size() > 0 || parkedPending_.load(std::memory_order_acquire)) wake_.Notify();
+    }
+
+private:
+    struct Item {
+        MidiMessage message;
+        bool urgent = false;
+        Clock::time_point since;
+    };
+
+    void Enqueue(const unsigned char* bytes, size_t size, int key, bool isUrgent) {
+        if (!running_ || size > 3) {
+            if (isUrgent) next_->SendUrgent(bytes, size);
+            else next_->Send(bytes, size);
+            return;
+        }
+        Item item;
+        std::copy(bytes, bytes + size, item.message.bytes);
+        item.message.size = static_cast<uint8_t>(size);
+        item.urgent = isUrgent;
+        item.since = Clock::now();
+
+        ClassStats& stats = isUrgent ? urgent : stream;
+        Policy policy = isUrgent ? urgentPolicy_ : streamPolicy_;
+        if (policy == Policy::COALESCE && key >= 0 && parkedPending_.load(std::memory_order_acquire)) {
+            // A stream with a parked value keeps using it until the output thread takes it, so a
+            // newer value never overtakes it through the queue. The other half of a parked 14-bit
+            // pair is parked with it for the same reason.
+            std::lock_guard<std::mutex> lock(parkedMutex_);
+            int partner = PairPartner(key);
+            if (parked_[key] || (partner >= 0 && parked_[partner])) {
+                Park(key, item.message);
+                stats.coalesced++;
+                return;
+            }
+        }
+        if (!queue_.TryPush(item)) {
+            if (policy == Policy::DROP) {
+                stats.dropped++;
+                return;
+            }
+            if (policy == Policy::COALESCE && key >= 0) {
+                {
+                    std::lock_guard<std::mutex> lock(parkedMutex_);
+                    Park(key, item.message);
+                }
+                stats.coalesced++;
+                wake_.Notify();
+                return;
+            }
+            stats.blocked++;
+            WaitToPush(item);
+        }
+        stats.queued++;
+        highWater = std::max(highWater, queue_.Size());
+    }
+
+    // The other controller of a 14-bit CC pair: the LSB for CC 0-31, the MSB for CC 32-63.
+    static int PairPartner(int key) {
+        int msb = MidiStreamMsbKey(key);
+        if (msb >= 0) return msb;
+        return MidiStreamMsbKey(key + 32) == key ? key + 32 : -1;
+    }
+
+    // Under parkedMutex_.
+    void Park(int key, const MidiMessage& message) {
+        if (!listed_[key]) {
+            listed_[key] = true;
+            parkedOrder_[parkedCount_++] = static_cast<uint16_t>(key);
+        }
+        parked_[key] = true;
+        parkedMessages_[key] = message;
+        // A parked LSB belongs to an older MSB, and a receiver clears it when this one arrives.
+        int lsb = key + 32;
+        if (MidiStreamMsbKey(lsb) == key) parked_[lsb] = false;
+        parkedPending_.store(true, std::memory_order_release);
+    }
+
+    // Block policy: sleeps until the output thread has made room.
+    void WaitToPush(const Item& item) {
+        while (true) {
+            spaceWake_.Arm();
+            if (queue_.TryPush(item)) break;
+            wake_.Notify();
+#ifndef _WIN32
+            struct pollfd pfd = {spaceWake_.Fd(), POLLIN, 0};
+            poll(&pfd, 1, -1);
+#else
+            spaceWake_.WaitUntil(std::chrono::steady_clock::time_point::max());
+#endif
+            spaceWake_.Disarm();
+        }
+        spaceWake_.Disarm();
+    }
+
+    void Run() {
+        while (true) {
+            bool sent = Drain();
+            if (sent) next_->EndFrame();
+            if (stop_.load() && !sent) break;
+            wake_.Arm();
+            if (queue_.Size() == 0 && !parkedPending_.load(std::memory_order_acquire) && !stop_.load()) {
+#ifndef _WIN32
+                struct pollfd pfd = {wake_.Fd(), POLLIN, 0};
+                poll(&pfd, 1, -1);
+#else
+                wake_.WaitUntil(std::chrono::steady_clock::time_point::max());
+#endif
+            }
+            wake_.Disarm();
+        }
+    }
+
+    // Output thread only. Returns whether anything was sent.
+    bool Drain() {
+        bool sent = false;
+        Item item;
+        while (queue_.TryPop(item)) {
+            spaceWake_.Notify(); // a blocked producer can push now; free when none is waiting
+            if (item.urgent) next_->SendUrgent(item.message);
+            else next_->Send(item.message);
+            latency.Record(Clock::now() - item.since);
+            sent = true;
+        }
+        if (parkedPending_.load(std::memory_order_acquire)) {
+            // Copy under the lock and send outside it, so producers never wait on the driver.
+            size_t count = 0;
+            {
+                std::lock_guard<std::mutex> lock(parkedMutex_);
+                for (size_t i = 0; i < parkedCount_; ++i) {
+                    uint16_t key = parkedOrder_[i];
+                    listed_[key] = false;
+                    if (!parked_[key]) continue; // sent ahead of its LSB, or a dropped LSB
+                    int msb = MidiStreamMsbKey(key);
+                    if (msb >= 0 && parked_[msb]) {
+                        draining_[count++] = parkedMessages_[msb];
+                        parked_[msb] = false;
+                    }
+                    draining_[count++] = parkedMessages_[key];
+                    parked_[key] = false;
+                }
+                parkedCount_ = 0;
+                parkedPending_.store(false, std::memory_order_relaxed);
+            }
+            for (size_t i = 0; i < count; ++i) next_->Send(draining_[i]);
+            sent = sent || count > 0;
+        }
+        return sent;
+    }
+
+    MidiOutput* next_;
+    SpscRing<Item, QUEUE_CAPACITY> queue_;
+    WakeSignal wake_;      // wakes the output thread
+    WakeSignal spaceWake_; // wakes the producer when it is blocked on a full queue
+    std::thread thread_;
+    std::atomic<bool> running_{false};
+    std::atomic<bool> stop_{false};
+    Policy urgentPolicy_ = Policy::BLOCK;
+    Policy streamPolicy_ = Policy::COALESCE;
+
+    // Coalesce overflow: newest value per stream key, guarded by parkedMutex_.
+    std::mutex parkedMutex_;
+    std::atomic<bool> parkedPending_{false};
+    std::array<bool, MIDI_STREAM_KEY_COUNT> parked_;
+    std::array<bool, MIDI_STREAM_KEY_COUNT> listed_; // has an entry in parkedOrder_
+    std::array<MidiMessage, MIDI_STREAM_KEY_COUNT> parkedMessages_;
+    std::array<uint16_t, MIDI_STREAM_KEY_COUNT> parkedOrder_;
+    size_t parkedCount_ = 0;
+    std::array<MidiMessage, MIDI_STREAM_KEY_COUNT> draining_; // output thread only
+};
+
+// --- MIDI Output Ports ---
+// A profile can send to several ports at once, such as a synth and a recorder. Every port has
+// its own pipeline: frame coalescing, the output budget, an output thread and the backend. Values
+// are therefore coalesced per port, and a slow port only backs up its own queue.
+constexpr size_t MAX_MIDI_PORTS = 16;
+
+struct MidiPort {
+    // The first port drives g_midiOut, which also lists the available ports. Later ones create
+    // their own RtMidi client only if they open on the RtMidi backend.
+    explicit MidiPort(RtMidiOut* client = nullptr)
+        : rtMidi(client), rtMidiOutput(client), async(rtMidiOutput), scheduled(async), frame(scheduled) {}
+    MidiPort(const MidiPort&) = delete;
+    MidiPort& operator=(const MidiPort&) = delete;
+
+    bool CreateRtMidiClient() {
+        if (rtMidi) return true;
+        try {
+            ownedClient.reset(new RtMidiOut());
+        } catch (const RtMidiError& error) {
+            std::cerr << "Error: Could not create a MIDI client for '" << name << "'. " << error.getMessage() << std::endl;
+            return false;
+        }
+        rtMidi = ownedClient.get();
+        rtMidiOutput.SetPort(*rtMidi);
+        return true;
+    }
+
+    std::string name; // for the monitor header and statistics
+    std::unique_ptr<RtMidiOut> ownedClient;
+    RtMidiOut* rtMidi; // null until an RtMidi port is opened
+    RtMidiOutput rtMidiOutput;
+#ifndef _WIN32
+    AlsaSeqOutput alsa;
+    RawMidiOutput raw;
+#endif
+    AsyncMidiOutput async;
+    ScheduledMidiOutput scheduled;
+    CoalescingMidiOutput frame;
+};
+
+// Passes each message to the ports selected for the mapping being dispatched; frame ends go to
+// every port. Dispatcher only.
+class FanOutMidiOutput : public MidiOutput {
+public:
+    explicit FanOutMidiOutput(MidiPort& first) { Add(first); }
+
+    bool Add(MidiPort& port) {
+        if (count_ == MAX_MIDI_PORTS) return false;
+        ports_[count_++] = &port;
+        selected_ = AllPorts();
+        return true;
+    }
+
+    size_t Count() const { return count_; }
+    MidiPort& Port(size_t index) const { return *ports_[index]; }
+    uint32_t AllPorts() const { return static_cast<uint32_t>((1u << count_) - 1); }
+
+    // A bit per port, as in MappingState::ports.
+    void Select(uint32_t ports) { selected_ = ports; }
+
+    void Send(const unsigned char* bytes, size_t size) override {
+        for (size_t i = 0; i < count_; ++i) {
+            if (selected_ & (1u << i)) ports_[i]->frame.Send(bytes, size);
+        }
+    }
+
+    void SendUrgent(const unsigned char* bytes, size_t size) override {
+        for (size_t i = 0; i < count_; ++i) {
+            if (selected_ & (1u << i)) ports_[i]->frame.SendUrgent(bytes, size);
+        }
+    }
+
+    void EndFrame() override {
+        for (size_t i = 0; i < count_; ++i) ports_[i]->frame.EndFrame();
+    }
+
+private:
+    std::array<MidiPort*, MAX_MIDI_PORTS> ports_{};
+    size_t count_ = 0;
+    uint32_t selected_ = 0;
 };
 
-// --- JSON Serialization ---
-NLOHMANN_JSON_SERIALIZE_ENUM(MidiMappingConfig::MidiMessageType, {
-    {MidiMappingConfig::MidiMessageType::NONE, nullptr},
-    {MidiMappingConfig::MidiMessageType::NOTE_ON_OFF, "NoteOnOff"},
-    {MidiMappingConfig::MidiMessageType::CC, "CC"}
-})
+// --- OSC Output ---
+// Sends controls to lighting and visuals software as OSC float messages over UDP. Axes are
+// normalized to 0-1 at full resolution instead of being quantized to MIDI steps. Everything
+// produced in one input frame goes out as one bundle, so a frame costs one datagram and one
+// syscall; within a frame an axis keeps only its newest value.
+class OscOutput {
+public:
+    static constexpr size_t MAX_DATAGRAM = 1472; // one Ethernet frame, no IP fragmentation
+    static constexpr size_t BUNDLE_HEADER = 16;  // "#bundle", then the time tag
 
-void to_json(json& j, const ControlInfo& ctrl) {
-    j = json{
-        {"isButton", ctrl.isButton}, {"logicalMin", ctrl.logicalMin},
-        {"logicalMax", ctrl.logicalMax}, {"name", ctrl.name}
-    };
+    ~OscOutput() { Close(); }
+
+    uint64_t messages = 0;   // messages added to a bundle
+    uint64_t collapsed = 0;  // axis values replaced by a newer one in the same bundle
+    uint64_t bundles = 0;    // datagrams sent
+    uint64_t sendErrors = 0; // datagrams the socket refused (buffer full, or no listener)
+
+    // target is "host:port"; a numeric IPv6 host goes in brackets ("[::1]:9000").
+    bool Open(const std::string& target) {
+        Close();
+        size_t colon = target.find_last_of(':');
+        if (colon == std::string::npos || colon == 0) {
+            std::cerr << "Error: OSC target '" << target << "' is not host:port." << std::endl;
+            return false;
+        }
+        std::string host = target.substr(0, colon);
+        std::string port = target.substr(colon + 1);
+        if (host.size() > 2 && host.front() == '[' && host.back() == ']') host = host.substr(1, host.size() - 2);
 #ifdef _WIN32
-    j["usagePage"] = ctrl.usagePage;
-    j["usage"] = ctrl.usage;
+        WSADATA wsaData;
+        if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
+            std::cerr << "Error: Could not initialize Winsock." << std::endl;
+            return false;
+        }
+        wsaStarted_ = true;
+#endif
+        struct addrinfo hints = {};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_DGRAM;
+        struct addrinfo* addresses = nullptr;
+        int err = getaddrinfo(host.c_str(), port.c_str(), &hints, &addresses);
+        if (err != 0) {
+#ifdef _WIN32
+            const char* reason = gai_strerrorA(err); // gai_strerror is the wide-character version under UNICODE
 #else
-    j["eventType"] = ctrl.eventType;
-    j["eventCode"] = ctrl.eventCode;
+            const char* reason = gai_strerror(err);
 #endif
-}
+            std::cerr << "Error: Could not resolve OSC target '" << target << "'. " << reason << std::endl;
+            Close();
+            return false;
+        }
+        // A connected socket lets each bundle go out with a plain send().
+        for (struct addrinfo* address = addresses; address; address = address->ai_next) {
+            socket_ = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+            if (socket_ == NO_SOCKET) continue;
+            if (connect(socket_, address->ai_addr, static_cast<int>(address->ai_addrlen)) == 0) break;
+            CloseSocket();
+        }
+        freeaddrinfo(addresses);
+        if (socket_ == NO_SOCKET) {
+            std::cerr << "Error: Could not open a UDP socket to OSC target '" << target << "'." << std::endl;
+            Close();
+            return false;
+        }
+#ifdef _WIN32
+        u_long nonBlocking = 1;
+        ioctlsocket(socket_, FIONBIO, &nonBlocking);
+#endif
+        return true;
+    }
 
-void from_json(const json& j, ControlInfo& ctrl) {
-    j.at("isButton").get_to(ctrl.isButton);
-    j.at("logicalMin").get_to(ctrl.logicalMin);
-    j.at("logicalMax").get_to(ctrl.logicalMax);
-    j.at("name").get_to(ctrl.name);
+    void Close() {
+        Flush();
+        CloseSocket();
 #ifdef _WIN32
-    ctrl.usagePage = j.value("usagePage", 0);
-    ctrl.usage = j.value("usage", 0);
+        if (wsaStarted_) WSACleanup();
+        wsaStarted_ = false;
+#endif
+    }
+
+    bool IsOpen() const { return socket_ != NO_SOCKET; }
+
+    // Sizes the per-frame coalescing for keys 0 to keyCount - 1 (mapping indices).
+    void SetKeyCount(size_t keyCount) {
+        slotOf_.assign(keyCount, -1);
+        touched_.clear();
+        touched_.reserve(keyCount);
+    }
+
+    // The address string and ",f" type tag of a float message, each null-terminated and padded
+    // to four bytes. Built once per mapping; Send() only appends the value.
+    static std::string EncodePrefix(const std::string& address) {
+        std::string prefix = address;
+        prefix.append(4 - address.size() % 4, '\0');
+        prefix.append(",f\0\0", 4);
+        return prefix;
+    }
+
+    // Adds one message to the frame's bundle. key is a mapping index whose earlier value in the
+    // same bundle is replaced, or -1 to always append (button edges).
+    void Send(int key, const std::string& prefix, float value) {
+        if (!IsOpen()) return;
+        messages++;
+        if (key >= 0 && slotOf_[key] >= 0) {
+            WriteFloat(static_cast<size_t>(slotOf_[key]), value);
+            collapsed++;
+            return;
+        }
+        size_t elementSize = 4 + prefix.size() + 4;
+        if (used_ + elementSize > buffer_.size()) Flush();
+        if (BUNDLE_HEADER + elementSize > buffer_.size()) {
+            sendErrors++; // the address alone does not fit in a datagram
+            return;
+        }
+        if (used_ == 0) {
+            static const unsigned char header[BUNDLE_HEADER] = {'#', 'b', 'u', 'n', 'd', 'l', 'e', 0, 0, 0, 0, 0, 0, 0, 0, 1};
+            std::memcpy(buffer_.data(), header, BUNDLE_HEADER); // time tag 1: "immediately"
+            used_ = BUNDLE_HEADER;
+        }
+        WriteUint32(used_, static_cast<uint32_t>(prefix.size() + 4));
+        std::memcpy(buffer_.data() + used_ + 4, prefix.data(), prefix.size());
+        size_t valueOffset = used_ + 4 + prefix.size();
+        WriteFloat(valueOffset, value);
+        used_ += elementSize;
+        if (key >= 0) {
+            slotOf_[key] = static_cast<int32_t>(valueOffset);
+            touched_.push_back(key);
+        }
+    }
+
+    void EndFrame() { Flush(); }
+
+private:
+#ifdef _WIN32
+    using Socket = SOCKET;
+    static constexpr Socket NO_SOCKET = INVALID_SOCKET;
 #else
-    ctrl.eventType = j.value("eventType", 0);
-    ctrl.eventCode = j.value("eventCode", 0);
+    using Socket = int;
+    static constexpr Socket NO_SOCKET = -1;
 #endif
-}
 
-void to_json(json& j, const MidiMappingConfig& cfg) {
-    j = json{
-        {"hidDevicePath", cfg.hidDevicePath}, {"hidDeviceName", cfg.hidDeviceName},
-        {"control", cfg.control}, {"midiDeviceName", cfg.midiDeviceName},
-        {"midiMessageType", cfg.midiMessageType}, {"midiChannel", cfg.midiChannel},
-        {"midiNoteOrCCNumber", cfg.midiNoteOrCCNumber}, {"midiValueNoteOnVelocity", cfg.midiValueNoteOnVelocity},
-        {"midiValueCCOn", cfg.midiValueCCOn}, {"midiValueCCOff", cfg.midiValueCCOff},
-        {"calibrationMinHid", cfg.calibrationMinHid}, {"calibrationMaxHid", cfg.calibrationMaxHid},
-        {"calibrationDone", cfg.calibrationDone}, {"reverseAxis", cfg.reverseAxis},
-        {"midiSendIntervalMs", cfg.midiSendIntervalMs}
-    };
-}
+    void Flush() {
+        if (used_ == 0) return;
+#ifdef _WIN32
+        int sent = send(socket_, reinterpret_cast<const char*>(buffer_.data()), static_cast<int>(used_), 0);
+#else
+        ssize_t sent = send(socket_, buffer_.data(), used_, MSG_DONTWAIT);
+#endif
+        if (sent == static_cast<decltype(sent)>(used_)) bundles++;
+        else sendErrors++;
+        used_ = 0;
+        for (int key : touched_) slotOf_[key] = -1;
+        touched_.clear();
+    }
 
-void from_json(const json& j, MidiMappingConfig& cfg) {
-    j.at("hidDevicePath").get_to(cfg.hidDevicePath);
-    j.at("hidDeviceName").get_to(cfg.hidDeviceName);
-    j.at("control").get_to(cfg.control);
-    j.at("midiDeviceName").get_to(cfg.midiDeviceName);
-    j.at("midiMessageType").get_to(cfg.midiMessageType);
-    j.at("midiChannel").get_to(cfg.midiChannel);
-    j.at("midiNoteOrCCNumber").get_to(cfg.midiNoteOrCCNumber);
-    cfg.midiValueNoteOnVelocity = j.value("midiValueNoteOnVelocity", 64);
-    cfg.midiValueCCOn = j.value("midiValueCCOn", 127);
-    cfg.midiValueCCOff = j.value("midiValueCCOff", 0);
-    cfg.calibrationMinHid = j.value("calibrationMinHid", 0);
-    cfg.calibrationMaxHid = j.value("calibrationMaxHid", 0);
-    cfg.calibrationDone = j.value("calibrationDone", false);
-    cfg.reverseAxis = j.value("reverseAxis", false);
-    cfg.midiSendIntervalMs = j.value("midiSendIntervalMs", 1);
-}
+    void CloseSocket() {
+        if (socket_ == NO_SOCKET) return;
+#ifdef _WIN32
+        closesocket(socket_);
+#else
+        close(socket_);
+#endif
+        socket_ = NO_SOCKET;
+    }
+
+    // OSC numbers are big-endian.
+    void WriteUint32(size_t offset, uint32_t value) {
+        buffer_[offset] = static_cast<unsigned char>(value >> 24);
+        buffer_[offset + 1] = static_cast<unsigned char>(value >> 16);
+        buffer_[offset + 2] = static_cast<unsigned char>(value >> 8);
+        buffer_[offset + 3] = static_cast<unsigned char>(value);
+    }
+
+    void WriteFloat(size_t offset, float value) {
+        uint32_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        WriteUint32(offset, bits);
+    }
+
+    Socket socket_ = NO_SOCKET;
+#ifdef _WIN32
+    bool wsaStarted_ = false;
+#endif
+    std::array<unsigned char, MAX_DATAGRAM> buffer_;
+    size_t used_ = 0;
+    std::vector<int32_t> slotOf_; // value offset in buffer_ per key staged this frame, or -1
+    std::vector<int> touched_;
+};
+
+// --- Mapping Table ---
+// Every active mapping gets a dense index that input events, the dispatcher and the display
+// all use. The table is built once before input starts and is not resized while running.
+struct MappingState {
+    const MidiMappingConfig* profile = nullptr;
+    const ControlMapping* config = nullptr;
+    LONG previousValue = 0;     // dispatcher-only
+    int lastSentMidiValue = -1; // dispatcher-only
+    bool axisPending = false;   // dispatcher-only, Coalesce policy
+    LONG pendingValue = 0;
+    AxisScaler scaler;          // compiled by CompileMappings() when monitoring starts
+    EncodedMapping encoded;     // compiled by CompileMappings() when monitoring starts
+    // midiSendIntervalMs limiter, dispatcher-only. A change after an idle period goes out at once;
+    // changes inside the interval are held and the newest one is sent when the interval ends.
+    std::chrono::steady_clock::duration sendInterval{};
+    std::chrono::steady_clock::time_point lastSendTime{};
+    bool trailingPending = false;
+    int trailingValue = 0;
+    int hysteresis = 0;         // stepHysteresis in 1/256ths of a step, compiled by CompileMappings()
+    // Axis filter, dispatcher-only. Devices only report changes, so while the filtered value still
+    // lags a resting stick the mapping is kept settling and re-filtered on a timer.
+    AxisFilter filter;
+    LONG rawValue = 0;
+    bool settling = false;
+    uint32_t ports = 1;         // a bit per output port (midiPorts), compiled by CompileMappings()
+    bool sendsMidi = true;      // false when the mapping has no MIDI message type (OSC only)
+    // OSC, compiled by CompileMappings() when the profile has an oscTarget and the mapping an oscAddress.
+    bool sendsOsc = false;
+    std::string oscPrefix;      // OscOutput::EncodePrefix(oscAddress)
+    AxisScaler oscScaler;       // same transfer function at OSC_OUTPUT_MAX resolution
+    int lastOscPosition = -1;   // dispatcher-only
+};
+
+// Axes go out over OSC as position / (OSC_OUTPUT_MAX << FRACTION_BITS): 30 bits, more than a float carries.
+constexpr int OSC_OUTPUT_MAX = (1 << 22) - 1;
 
 // --- Global State ---
 std::atomic<bool> g_quitFlag(false);
-std::atomic<LONG> g_currentValue(0);
-std::atomic<bool> g_valueChanged(false);
-LONG g_previousValue = -1;
-int g_lastSentMidiValue = -1;
+std::vector<MidiMappingConfig> g_profiles;  // one per input device; g_profiles[0] is set up interactively
+std::vector<MappingState> g_mappings;       // every mapping of every profile, in profile order
+std::vector<uint16_t> g_pendingAxisMappings; // dispatcher-only, mappings with a coalesced axis value
+std::vector<uint16_t> g_rateLimitedMappings; // dispatcher-only, mappings holding a trailing value
+uint64_t g_rateLimitDeferred = 0;   // values held back by the limiter
+uint64_t g_rateLimitSuperseded = 0; // held values replaced before they were sent
+uint64_t g_hysteresisHeld = 0;       // axis values that crossed a step boundary but not the hysteresis margin
+uint64_t g_deadzoneAbsorbed = 0;     // axis values inside a deadzone that sent nothing
+uint64_t g_msbSkipped = 0;           // 14-bit CC and NRPN/RPN values sent as an LSB alone
+// The NRPN/RPN parameter each port's receiver has selected per channel, or -1 when unknown.
+// Mappings on one channel share it, so the select pair is only resent when the parameter changes.
+std::array<std::array<int, 16>, MAX_MIDI_PORTS> g_selectedParameter;
+uint64_t g_parameterSelects = 0;     // NRPN/RPN select pairs sent
+std::vector<uint16_t> g_settlingMappings; // filtered mappings still converging on a resting value
+const auto FILTER_SETTLE_INTERVAL = std::chrono::milliseconds(4);
+std::vector<std::atomic<LONG>> g_currentValues; // latest published value per mapping, for display and calibration
+std::atomic<uint16_t> g_lastChangedMapping(0);  // the display follows whichever control moved last
+std::atomic<uint64_t> g_valueGeneration(0);     // bumped on every published change, so the display knows to redraw
+std::atomic<bool> g_dispatchActive(false); // input is queued for MIDI only while monitoring
+InputEventQueue g_inputQueue;
+WakeSignal g_dispatchWake;
+std::atomic<uint64_t> g_dispatchWakeups(0);
 RtMidiOut g_midiOut;
-MidiMappingConfig g_currentConfig;
+MidiPort g_primaryPort(&g_midiOut);                   // midiDeviceName
+std::vector<std::unique_ptr<MidiPort>> g_extraPorts; // midiExtraDeviceNames
+FanOutMidiOutput g_fanOutput(g_primaryPort);
+MidiOutput* g_output = &g_fanOutput;
+OscOutput g_oscOutput; // the first profile's oscTarget
 std::thread g_inputThread;
+std::atomic<bool> g_inputStop(false);
+bool g_singleThreaded = false; // --single-thread: one epoll loop does input, MIDI and display (Linux)
 std::mutex g_consoleMutex;
 
 // --- Forward Declarations ---
@@ -171,7 +1933,10 @@ bool string_ends_with(const std::string& str, const std::string& suffix);
 bool SaveConfiguration(const MidiMappingConfig& config, const std::string& filename);
 bool LoadConfiguration(const std::string& filename, MidiMappingConfig& config);
 std::vector<fs::path> ListConfigurations(const std::string& directory);
-bool PerformCalibration();
+bool PerformCalibration(ControlMapping& config, size_t mapping);
+void DispatchInputEvent(const InputEvent& ev);
+std::chrono::steady_clock::time_point RunDispatchTimers(std::chrono::steady_clock::time_point now);
+void EndOutputFrame();
 
 // ===================================================================================
 //
@@ -342,28 +2107,45 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
         if (GetRawInputData((HRAWINPUT)lParam, RID_INPUT, lpb.get(), &dwSize, sizeof(RAWINPUTHEADER)) != dwSize) return 0;
 
         RAWINPUT* raw = (RAWINPUT*)lpb.get();
+        // Windows monitors the mappings of the first profile only.
         if (raw->header.dwType == RIM_TYPEHID && g_preparsedData) {
-            ULONG value = 0;
-            if (g_currentConfig.control.isButton) {
-                USAGE usage = g_currentConfig.control.usage;
-                ULONG usageCount = 1;
-                if (HidP_GetUsages(HidP_Input, g_currentConfig.control.usagePage, 0, &usage, &usageCount, g_preparsedData, (PCHAR)raw->data.hid.bRawData, raw->data.hid.dwSizeHid) == HIDP_STATUS_SUCCESS) {
-                    value = 1;
+            bool queued = false;
+            for (size_t i = 0; i < g_mappings.size() && g_mappings[i].profile == &g_profiles.front(); ++i) {
+                const ControlInfo& control = g_mappings[i].config->control;
+                ULONG value = 0;
+                if (control.isButton) {
+                    USAGE usage = control.usage;
+                    ULONG usageCount = 1;
+                    if (HidP_GetUsages(HidP_Input, control.usagePage, 0, &usage, &usageCount, g_preparsedData, (PCHAR)raw->data.hid.bRawData, raw->data.hid.dwSizeHid) == HIDP_STATUS_SUCCESS) {
+                        value = 1;
+                    } else {
+                        value = 0;
+                    }
                 } else {
-                    value = 0;
+                    HidP_GetUsageValue(HidP_Input, control.usagePage, 0, control.usage, &value, g_preparsedData, (PCHAR)raw->data.hid.bRawData, raw->data.hid.dwSizeHid);
+                }
+                if (static_cast<LONG>(value) == g_currentValues[i].load()) continue;
+
+                g_currentValues[i] = value;
+                g_lastChangedMapping.store(static_cast<uint16_t>(i), std::memory_order_relaxed);
+                g_valueGeneration.fetch_add(1, std::memory_order_relaxed);
+                if (g_dispatchActive) {
+                    InputEvent event;
+                    event.timestampUs = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+                    event.value = static_cast<LONG>(value);
+                    event.mapping = static_cast<uint16_t>(i);
+                    event.flags = InputEventFlagsFor(*g_mappings[i].config);
+                    g_inputQueue.Push(event);
+                    queued = true;
                 }
-            } else {
-                HidP_GetUsageValue(HidP_Input, g_currentConfig.control.usagePage, 0, g_currentConfig.control.usage, &value, g_preparsedData, (PCHAR)raw->data.hid.bRawData, raw->data.hid.dwSizeHid);
-            }
-            if (static_cast<LONG>(value) != g_currentValue.load()) {
-                g_currentValue = value;
-                g_valueChanged = true;
             }
+            if (queued) g_dispatchWake.Notify();
         }
         return DefWindowProc(hwnd, uMsg, wParam, lParam);
     }
     if (uMsg == WM_DESTROY) {
         g_quitFlag = true;
+        g_dispatchWake.Notify();
         PostQuitMessage(0);
         return 0;
     }
@@ -495,36 +2277,461 @@ std::vector<ControlInfo> GetAvailableControls(const std::string& devicePath) {
     return controls;
 }
 
-void InputMonitorLoop() {
-    int fd = open(g_currentConfig.hidDevicePath.c_str(), O_RDONLY | O_NONBLOCK);
-    if (fd < 0) {
-        std::lock_guard<std::mutex> lock(g_consoleMutex);
-        std::cerr << "\nError: Could not open device " << g_currentConfig.hidDevicePath << " in input thread. " << strerror(errno) << std::endl;
-        return;
+// --- Linux Input Statistics ---
+// Evdev delivers a whole report (several ABS/KEY events + SYN_REPORT) at once, so the
+// reader drains the fd into a fixed batch per read() instead of one event per wakeup.
+constexpr size_t INPUT_EVENT_BATCH = 64;
+std::atomic<uint64_t> g_inputSyscalls(0);
+std::atomic<uint64_t> g_inputEventsRead(0);
+std::atomic<uint64_t> g_inputFrames(0);
+
+// --- Linux Dispatch Table ---
+// Compiled (type, code) -> slot lookup for one device, so routing an event costs one indexed
+// load however many mappings the device has. Rows are EV_KEY codes followed by EV_ABS codes;
+// each row is a [begin, end) range into a flat list of slot indices (CSR layout).
+class EvdevDispatchTable {
+public:
+    template <typename ControlOf>
+    void Build(size_t slotCount, ControlOf&& controlOf) {
+        std::vector<uint16_t> counts(ROW_COUNT + 1, 0);
+        for (size_t i = 0; i < slotCount; ++i) {
+            int row = Row(controlOf(i).eventType, controlOf(i).eventCode);
+            if (row >= 0) counts[row + 1]++;
+        }
+        for (int row = 0; row < ROW_COUNT; ++row) counts[row + 1] += counts[row];
+        rowStart_ = counts;
+        slots_.assign(counts[ROW_COUNT], 0);
+        for (size_t i = 0; i < slotCount; ++i) {
+            int row = Row(controlOf(i).eventType, controlOf(i).eventCode);
+            if (row >= 0) slots_[counts[row]++] = static_cast<uint16_t>(i);
+        }
     }
 
-    struct input_event ev;
-    struct pollfd pfd;
-    pfd.fd = fd;
-    pfd.events = POLLIN;
+    // Returns the slots mapped to (type, code) as a [first, last) pointer range.
+    std::pair<const uint16_t*, const uint16_t*> Lookup(uint16_t type, uint16_t code) const {
+        int row = Row(type, code);
+        if (row < 0 || rowStart_.empty()) return {nullptr, nullptr};
+        return {slots_.data() + rowStart_[row], slots_.data() + rowStart_[row + 1]};
+    }
 
-    while (!g_quitFlag) {
-        int ret = poll(&pfd, 1, 100);
-        if (ret < 0 || !(pfd.revents & POLLIN)) continue;
-
-        if (read(fd, &ev, sizeof(ev)) == sizeof(ev)) {
-            if (ev.type == g_currentConfig.control.eventType && ev.code == g_currentConfig.control.eventCode) {
-                if (static_cast<LONG>(ev.value) != g_currentValue.load()) {
-                    g_currentValue = ev.value;
-                    g_valueChanged = true;
+private:
+    static constexpr int KEY_ROWS = KEY_MAX + 1;
+    static constexpr int ABS_ROWS = ABS_MAX + 1;
+    static constexpr int ROW_COUNT = KEY_ROWS + ABS_ROWS;
+
+    static int Row(uint16_t type, uint16_t code) {
+        if (type == EV_KEY && code < KEY_ROWS) return code;
+        if (type == EV_ABS && code < ABS_ROWS) return KEY_ROWS + code;
+        return -1;
+    }
+
+    std::vector<uint16_t> rowStart_;
+    std::vector<uint16_t> slots_;
+};
+
+// --- Linux Input Frames ---
+// Evdev groups events into reports terminated by SYN_REPORT. Values are staged until the
+// report is complete and then published together, so the dispatcher never acts on a
+// half-applied report and evaluates MIDI output once per frame instead of once per event.
+struct InputFrameAssembler {
+    struct Slot {
+        uint16_t mapping = 0;
+        LONG value = 0;
+        uint64_t timeUs = 0;
+        bool changed = false;
+        bool listed = false;
+    };
+
+    int fd = -1;
+    uint16_t device = 0;
+    std::vector<Slot> slots;          // one per mapping routed to this device
+    EvdevDispatchTable routes;        // rebuilt by Rebuild() whenever slots change
+    std::vector<size_t> changedSlots; // slots touched since the last SYN_REPORT
+    bool dropping = false;            // after SYN_DROPPED everything up to the next SYN_REPORT is stale
+    uint64_t frameCount = 0;
+    uint64_t droppedReports = 0;
+
+    static uint64_t EventTimeUs(const struct input_event& ev) {
+        return static_cast<uint64_t>(ev.input_event_sec) * 1000000ULL + static_cast<uint64_t>(ev.input_event_usec);
+    }
+
+    const ControlInfo& Control(const Slot& slot) const {
+        return g_mappings[slot.mapping].config->control;
+    }
+
+    void Rebuild() {
+        routes.Build(slots.size(), [this](size_t i) -> const ControlInfo& { return Control(slots[i]); });
+        changedSlots.reserve(slots.size());
+    }
+
+    void Stage(size_t index, LONG value, uint64_t timeUs) {
+        Slot& slot = slots[index];
+        // A button that flips twice inside one report would lose an edge; publish the first one early.
+        if (slot.changed && Control(slot).isButton && value != slot.value) Publish();
+        slot.value = value;
+        slot.timeUs = timeUs;
+        slot.changed = value != g_currentValues[slot.mapping].load(std::memory_order_relaxed);
+        if (slot.changed && !slot.listed) {
+            slot.listed = true;
+            changedSlots.push_back(index);
+        }
+    }
+
+    void Publish() {
+        frameCount++;
+        g_inputFrames++;
+        bool queued = false;
+        for (size_t index : changedSlots) {
+            Slot& slot = slots[index];
+            slot.listed = false;
+            if (!slot.changed) continue;
+            slot.changed = false;
+            g_currentValues[slot.mapping] = slot.value;
+            g_lastChangedMapping.store(slot.mapping, std::memory_order_relaxed);
+            g_valueGeneration.fetch_add(1, std::memory_order_relaxed);
+            if (!g_dispatchActive) continue;
+
+            InputEvent event;
+            event.timestampUs = slot.timeUs;
+            event.value = slot.value;
+            event.mapping = slot.mapping;
+            event.device = device;
+            event.flags = InputEventFlagsFor(*g_mappings[slot.mapping].config);
+            if (g_singleThreaded) {
+                DispatchInputEvent(event);
+            } else {
+                g_inputQueue.Push(event);
+                queued = true;
+            }
+        }
+        changedSlots.clear();
+        if (queued) g_dispatchWake.Notify();
+        if (g_singleThreaded && g_dispatchActive) EndOutputFrame();
+    }
+
+    // Re-reads every mapped control's state after the kernel dropped events.
+    void Resync(uint64_t timeUs) {
+        unsigned long key_bits[KEY_MAX / BITS_PER_LONG + 1] = {0};
+        bool haveKeys = ioctl(fd, EVIOCGKEY(sizeof(key_bits)), key_bits) >= 0;
+        for (size_t i = 0; i < slots.size(); ++i) {
+            const ControlInfo& ctrl = Control(slots[i]);
+            if (ctrl.eventType == EV_KEY && haveKeys) {
+                Stage(i, (key_bits[ctrl.eventCode / BITS_PER_LONG] >> (ctrl.eventCode % BITS_PER_LONG)) & 1, timeUs);
+            } else if (ctrl.eventType == EV_ABS) {
+                struct input_absinfo abs_info;
+                if (ioctl(fd, EVIOCGABS(ctrl.eventCode), &abs_info) >= 0) Stage(i, abs_info.value, timeUs);
+            }
+        }
+    }
+
+    void Feed(const struct input_event& ev) {
+        if (ev.type == EV_SYN) {
+            if (ev.code == SYN_DROPPED) {
+                for (size_t index : changedSlots) slots[index].changed = slots[index].listed = false;
+                changedSlots.clear();
+                dropping = true;
+                droppedReports++;
+            } else if (ev.code == SYN_REPORT) {
+                if (dropping) {
+                    dropping = false;
+                    Resync(EventTimeUs(ev));
                 }
+                Publish();
+            }
+            return;
+        }
+        if (dropping) return;
+        auto range = routes.Lookup(ev.type, ev.code);
+        for (const uint16_t* slot = range.first; slot != range.second; ++slot) {
+            Stage(*slot, ev.value, EventTimeUs(ev));
+        }
+    }
+};
+
+// --- Linux Input Reactor ---
+struct InputDevice {
+    uint16_t id = 0;
+    std::string path;
+    std::string name;
+    int fd = -1;
+    bool lost = false;
+    int readError = 0; // errno of the read that lost the device; 0 if it reported end of file
+    InputFrameAssembler frames;
+    // Written by whichever thread runs the reactor; read once it has stopped.
+    uint64_t reads = 0;
+    uint64_t events = 0;
+};
+
+// Reads every pending event from a non-blocking evdev fd. Returns false once the device is gone.
+bool DrainInputDevice(InputDevice& device) {
+    struct input_event events[INPUT_EVENT_BATCH];
+    while (true) {
+        ssize_t bytes = read(device.fd, events, sizeof(events));
+        device.reads++;
+        g_inputSyscalls++;
+        if (bytes < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return true;
+            device.readError = errno;
+            return false;
+        }
+        if (bytes == 0) {
+            device.readError = 0;
+            return false;
+        }
+        size_t count = static_cast<size_t>(bytes) / sizeof(struct input_event);
+        device.events += count;
+        g_inputEventsRead += count;
+        for (size_t i = 0; i < count; ++i) {
+            device.frames.Feed(events[i]);
+        }
+        // A short read means the kernel buffer is empty; skip the read() that would only return EAGAIN.
+        if (count < INPUT_EVENT_BATCH) return true;
+    }
+}
+
+// Owns any number of evdev nodes in one epoll set. Each device carries its own frame assembler
+// and mapping routes, and tags every event with its id, so one thread can serve dozens of
+// controllers and the rest of the pipeline can still tell them apart.
+class InputReactor {
+public:
+    InputReactor() = default;
+    ~InputReactor() {
+        for (auto& device : devices_) {
+            if (device->fd >= 0) close(device->fd);
+        }
+        if (epollFd_ >= 0) close(epollFd_);
+    }
+    InputReactor(const InputReactor&) = delete;
+    InputReactor& operator=(const InputReactor&) = delete;
+
+    // Routes a mapping to the device at path, opening the device on first use.
+    bool AddMapping(uint16_t mapping, const std::string& path, const std::string& name) {
+        if (epollFd_ < 0) epollFd_ = epoll_create1(EPOLL_CLOEXEC);
+        if (epollFd_ < 0) return false;
+
+        InputDevice* device = nullptr;
+        for (auto& existing : devices_) {
+            if (existing->path == path) device = existing.get();
+        }
+        if (!device) {
+            int fd = open(path.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+            if (fd < 0) {
+                std::cerr << "\nError: Could not open device " << path << ". " << strerror(errno) << std::endl;
+                return false;
+            }
+            // Stamp events with the same clock as steady_clock so filters and timers share a time base.
+            int clockId = CLOCK_MONOTONIC;
+            ioctl(fd, EVIOCSCLOCKID, &clockId);
+            auto added = std::make_unique<InputDevice>();
+            added->id = static_cast<uint16_t>(devices_.size());
+            added->path = path;
+            added->name = name;
+            added->fd = fd;
+            added->frames.fd = fd;
+            added->frames.device = added->id;
+
+            struct epoll_event ev = {};
+            ev.events = EPOLLIN;
+            ev.data.u64 = added->id;
+            if (epoll_ctl(epollFd_, EPOLL_CTL_ADD, fd, &ev) < 0) {
+                close(fd);
+                return false;
             }
+            device = added.get();
+            devices_.push_back(std::move(added));
         }
+        InputFrameAssembler::Slot slot;
+        slot.mapping = mapping;
+        device->frames.slots.push_back(slot);
+        device->frames.Rebuild();
+        return true;
+    }
+
+    // Adds a non-device fd; Poll() reports it to the caller instead of reading it.
+    bool Watch(int fd) {
+        if (epollFd_ < 0) epollFd_ = epoll_create1(EPOLL_CLOEXEC);
+        struct epoll_event ev = {};
+        ev.events = EPOLLIN;
+        ev.data.u64 = EXTERNAL_FD_TAG | static_cast<uint32_t>(fd);
+        return epoll_ctl(epollFd_, EPOLL_CTL_ADD, fd, &ev) == 0;
+    }
+
+    size_t ActiveDevices() const {
+        return std::count_if(devices_.begin(), devices_.end(), [](const auto& d) { return !d->lost; });
+    }
+
+    const std::vector<std::unique_ptr<InputDevice>>& Devices() const { return devices_; }
+
+    // Waits up to timeoutMs (-1 = forever), drains every ready device and hands ready
+    // external fds to onExternal. Returns the number of ready fds, or -1 on error.
+    template <typename OnExternal>
+    int Poll(int timeoutMs, OnExternal&& onExternal) {
+        struct epoll_event ready[32];
+        int count = epoll_wait(epollFd_, ready, 32, timeoutMs);
+        g_inputSyscalls++;
+        if (count < 0) return errno == EINTR ? 0 : -1;
+        for (int i = 0; i < count; ++i) {
+            uint64_t tag = ready[i].data.u64;
+            if (tag & EXTERNAL_FD_TAG) {
+                onExternal(static_cast<int>(tag & ~EXTERNAL_FD_TAG));
+                continue;
+            }
+            InputDevice& device = *devices_[tag];
+            if (!device.lost && !DrainInputDevice(device)) Drop(device);
+        }
+        return count;
+    }
+
+private:
+    static constexpr uint64_t EXTERNAL_FD_TAG = 1ULL << 63;
+
+    void Drop(InputDevice& device) {
+        {
+            std::lock_guard<std::mutex> lock(g_consoleMutex);
+            std::cerr << "\nError: Lost device " << device.path << ". "
+                      << (device.readError ? strerror(device.readError) : "End of file (device removed?)") << std::endl;
+        }
+        epoll_ctl(epollFd_, EPOLL_CTL_DEL, device.fd, nullptr);
+        close(device.fd);
+        device.fd = -1;
+        device.lost = true;
+    }
+
+    int epollFd_ = -1;
+    std::vector<std::unique_ptr<InputDevice>> devices_;
+};
+
+InputReactor g_inputReactor;
+
+// Opens the input device of every mapping. Returns false if none could be opened.
+bool OpenInputDevices() {
+    for (size_t i = 0; i < g_mappings.size(); ++i) {
+        const MidiMappingConfig& profile = *g_mappings[i].profile;
+        g_inputReactor.AddMapping(static_cast<uint16_t>(i), profile.hidDevicePath, profile.hidDeviceName);
+    }
+    return g_inputReactor.ActiveDevices() > 0;
+}
+
+void PrintInputStatistics() {
+    uint64_t events = g_inputEventsRead.load();
+    uint64_t syscalls = g_inputSyscalls.load();
+    std::cout << "Input: " << events << " events in " << g_inputFrames.load() << " frames, " << syscalls << " syscalls";
+    if (events > 0) {
+        std::cout << " (" << std::fixed << std::setprecision(3) << static_cast<double>(syscalls) / events << " syscalls/event)";
+    }
+    std::cout << std::endl;
+    for (const auto& device : g_inputReactor.Devices()) {
+        std::cout << "  [" << device->id << "] " << device->name << " (" << device->path << "): "
+                  << device->events << " events, " << device->frames.frameCount << " frames, "
+                  << device->reads << " reads, " << device->frames.droppedReports << " dropped reports"
+                  << (device->lost ? ", lost" : "") << std::endl;
+    }
+}
+
+void InputMonitorLoop() {
+    while (!g_quitFlag && !g_inputStop && g_inputReactor.ActiveDevices() > 0) {
+        // Parked queue entries are retried quickly until the dispatcher catches up.
+        if (g_inputReactor.Poll(g_inputQueue.HasBacklog() ? 1 : 100, [](int) {}) < 0) break;
+        if (g_inputQueue.HasBacklog()) {
+            g_inputQueue.Flush();
+            g_dispatchWake.Notify();
+        }
+    }
+    // With no devices left there is nothing to monitor, as in the single-threaded loop.
+    if (!g_inputStop) {
+        g_quitFlag = true;
+        g_dispatchWake.Notify();
     }
-    close(fd);
     std::cout << "\nInput monitoring thread finished." << std::endl;
 }
 
+// --- Linux Single-Threaded Event Loop ---
+// The input reactor's epoll set also takes stdin, a display timerfd and a signalfd for
+// shutdown, so every event goes from read() to RtMidiOut::sendMessage on one thread with no handoff.
+void RunEventLoop() {
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    sigprocmask(SIG_BLOCK, &mask, nullptr);
+    int sigFd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    int timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    int dispatchTimerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (sigFd < 0 || timerFd < 0 || dispatchTimerFd < 0 || !g_inputReactor.Watch(STDIN_FILENO) ||
+        !g_inputReactor.Watch(sigFd) || !g_inputReactor.Watch(timerFd) || !g_inputReactor.Watch(dispatchTimerFd)) {
+        std::cerr << "\nError: Could not set up the event loop. " << strerror(errno) << std::endl;
+        if (sigFd >= 0) close(sigFd);
+        if (timerFd >= 0) close(timerFd);
+        if (dispatchTimerFd >= 0) close(dispatchTimerFd);
+        sigprocmask(SIG_UNBLOCK, &mask, nullptr);
+        return;
+    }
+
+    // The display timer is only armed while a redraw is pending, so an idle loop never wakes.
+    const auto displayInterval = std::chrono::milliseconds(1000 / 60);
+    DisplayMonitoringOutput();
+    uint64_t displayedGeneration = g_valueGeneration.load();
+    auto lastDisplayTime = std::chrono::steady_clock::now();
+    bool timerArmed = false;
+    // steady_clock is CLOCK_MONOTONIC, so dispatcher deadlines arm the timer as absolute times.
+    auto dispatchDeadline = std::chrono::steady_clock::time_point::max();
+
+    auto onExternal = [&](int ready) {
+        if (ready == STDIN_FILENO) {
+            g_quitFlag = true;
+        } else if (ready == sigFd) {
+            struct signalfd_siginfo info;
+            while (read(sigFd, &info, sizeof(info)) == sizeof(info)) {}
+            g_quitFlag = true;
+        } else if (ready == timerFd) {
+            uint64_t expirations;
+            while (read(timerFd, &expirations, sizeof(expirations)) == sizeof(expirations)) {}
+            timerArmed = false;
+        } else if (ready == dispatchTimerFd) {
+            uint64_t expirations;
+            while (read(dispatchTimerFd, &expirations, sizeof(expirations)) == sizeof(expirations)) {}
+        }
+    };
+
+    while (!g_quitFlag && g_inputReactor.ActiveDevices() > 0) {
+        if (g_inputReactor.Poll(-1, onExternal) < 0) break;
+
+        auto nextSend = RunDispatchTimers(std::chrono::steady_clock::now());
+        if (nextSend != dispatchDeadline) {
+            struct itimerspec spec = {};
+            if (nextSend != std::chrono::steady_clock::time_point::max()) {
+                auto at = std::chrono::duration_cast<std::chrono::nanoseconds>(nextSend.time_since_epoch()).count();
+                spec.it_value.tv_sec = at / 1000000000;
+                spec.it_value.tv_nsec = at % 1000000000;
+            }
+            timerfd_settime(dispatchTimerFd, TFD_TIMER_ABSTIME, &spec, nullptr);
+            dispatchDeadline = nextSend;
+        }
+
+        if (!timerArmed && g_valueGeneration.load() != displayedGeneration) {
+            auto now = std::chrono::steady_clock::now();
+            if (now - lastDisplayTime >= displayInterval) {
+                displayedGeneration = g_valueGeneration.load();
+                DisplayMonitoringOutput();
+                lastDisplayTime = now;
+            } else {
+                auto remaining = std::chrono::duration_cast<std::chrono::nanoseconds>(displayInterval - (now - lastDisplayTime)).count();
+                struct itimerspec spec = {};
+                spec.it_value.tv_sec = remaining / 1000000000;
+                spec.it_value.tv_nsec = remaining % 1000000000;
+                timerfd_settime(timerFd, 0, &spec, nullptr);
+                timerArmed = true;
+            }
+        }
+    }
+
+    close(dispatchTimerFd);
+    close(timerFd);
+    close(sigFd);
+    sigprocmask(SIG_UNBLOCK, &mask, nullptr);
+}
+
 #endif
 
 // ===================================================================================
@@ -575,26 +2782,29 @@ void DisplayMonitoringOutput() {
     const int BAR_WIDTH = 30;
     const int DISPLAY_WIDTH = 80;
     std::stringstream ss;
+    uint16_t mapping = g_lastChangedMapping.load(std::memory_order_relaxed);
+    const ControlMapping& config = *g_mappings[mapping].config;
+    LONG value = g_currentValues[mapping].load();
 
-    ss << "[" << std::left << std::setw(20) << g_currentConfig.control.name.substr(0, 20) << "] ";
+    ss << "[" << std::left << std::setw(20) << config.control.name.substr(0, 20) << "] ";
 
-    if (g_currentConfig.control.isButton) {
-        ss << (g_currentValue.load() ? "[ ### ON ### ]" : "[ --- OFF -- ]");
+    if (config.control.isButton) {
+        ss << (value ? "[ ### ON ### ]" : "[ --- OFF -- ]");
     } else {
         double percentage = 0.0;
-        LONG displayRangeMin = g_currentConfig.control.logicalMin;
-        LONG displayRangeMax = g_currentConfig.control.logicalMax;
+        LONG displayRangeMin = config.control.logicalMin;
+        LONG displayRangeMax = config.control.logicalMax;
 
-        if (g_currentConfig.calibrationDone) {
-            displayRangeMin = g_currentConfig.calibrationMinHid;
-            displayRangeMax = g_currentConfig.calibrationMaxHid;
+        if (config.calibrationDone) {
+            displayRangeMin = config.calibrationMinHid;
+            displayRangeMax = config.calibrationMaxHid;
         }
 
         LONG displayRange = displayRangeMax - displayRangeMin;
         if (displayRange > 0) {
-            LONG clampedValue = std::max(displayRangeMin, std::min(displayRangeMax, g_currentValue.load()));
+            LONG clampedValue = std::max(displayRangeMin, std::min(displayRangeMax, value));
             percentage = static_cast<double>(clampedValue - displayRangeMin) * 100.0 / static_cast<double>(displayRange);
-        } else if (g_currentValue.load() >= displayRangeMax) {
+        } else if (value >= displayRangeMax) {
             percentage = 100.0;
         }
 
@@ -606,7 +2816,7 @@ void DisplayMonitoringOutput() {
 
         ss << "|" << bar << empty << "| ";
         ss << std::fixed << std::setprecision(1) << std::setw(5) << percentage << "% ";
-        ss << "(Raw:" << std::right << std::setw(6) << g_currentValue.load() << ")";
+        ss << "(Raw:" << std::right << std::setw(6) << value << ")";
     }
 
     std::string outputStr = ss.str();
@@ -656,15 +2866,109 @@ std::vector<fs::path> ListConfigurations(const std::string& directory) {
                 configFiles.push_back(entry.path());
             }
         }
-    } catch (const std::exception& e) {
-        std::cerr << "Error listing configs: " << e.what() << std::endl;
+    } catch (const std::exception& e) {
+        std::cerr << "Error listing configs: " << e.what() << std::endl;
+    }
+    std::sort(configFiles.begin(), configFiles.end());
+    return configFiles;
+}
+
+// Assigns a mapping index to every mapping of every loaded profile. Must run before input starts.
+void BuildMappingTable() {
+    g_mappings.clear();
+    for (const auto& profile : g_profiles) {
+        for (const auto& mapping : profile.mappings) {
+            MappingState state;
+            state.profile = &profile;
+            state.config = &mapping;
+            g_mappings.push_back(state);
+        }
+    }
+    g_currentValues = std::vector<std::atomic<LONG>>(g_mappings.size());
+    g_pendingAxisMappings.reserve(g_mappings.size());
+    g_rateLimitedMappings.reserve(g_mappings.size());
+    g_settlingMappings.reserve(g_mappings.size());
+}
+
+// Precomputes everything the dispatcher needs per mapping. Runs once calibration is final,
+// right before monitoring starts.
+void CompileMappings() {
+    for (auto& mapping : g_mappings) {
+        const ControlMapping& config = *mapping.config;
+        EncodedMapping& encoded = mapping.encoded;
+        encoded.axisFormat = EncodedMapping::AxisFormat::CC7;
+        if (config.midiMessageType == ControlMapping::MidiMessageType::CC_14BIT) {
+            if (config.midiNoteOrCCNumber < 32) {
+                encoded.axisFormat = EncodedMapping::AxisFormat::CC14;
+            } else {
+                std::cerr << "Warning: 14-bit CC needs a CC number from 0 to 31; " << config.control.name
+                          << " will send 7-bit CC " << config.midiNoteOrCCNumber << "." << std::endl;
+            }
+        }
+        if (config.midiMessageType == ControlMapping::MidiMessageType::PITCH_BEND) {
+            encoded.axisFormat = EncodedMapping::AxisFormat::PITCH_BEND;
+        }
+        bool rpn = config.midiMessageType == ControlMapping::MidiMessageType::RPN;
+        if (rpn || config.midiMessageType == ControlMapping::MidiMessageType::NRPN) {
+            int parameter = std::max(0, std::min(16383, config.midiNoteOrCCNumber));
+            encoded.axisFormat = EncodedMapping::AxisFormat::PARAMETER;
+            encoded.selectMsb = MakeMidiMessage(0xB0 | config.midiChannel, rpn ? 101 : 99, parameter >> 7);
+            encoded.selectLsb = MakeMidiMessage(0xB0 | config.midiChannel, rpn ? 100 : 98, parameter & 0x7F);
+            encoded.parameterKey = (rpn ? 1 << 14 : 0) | parameter;
+        }
+        encoded.channel = config.midiChannel & 0x0F;
+        encoded.outputMax = encoded.axisFormat == EncodedMapping::AxisFormat::CC7 ? 127 : 16383;
+        mapping.scaler.Build(config, encoded.outputMax);
+        mapping.sendInterval = std::chrono::milliseconds(std::max(0, config.midiSendIntervalMs));
+        mapping.filter.Configure(config);
+        mapping.hysteresis = static_cast<int>(std::max(0.0, std::min(0.5, config.stepHysteresis)) * AxisScaler::HALF_STEP * 2);
+        mapping.ports = 0;
+        for (int port : config.midiPorts) {
+            if (port >= 0 && static_cast<size_t>(port) < g_fanOutput.Count()) {
+                mapping.ports |= 1u << port;
+            } else {
+                std::cerr << "Warning: " << config.control.name << " names MIDI port " << port
+                          << ", but only " << g_fanOutput.Count() << " are configured." << std::endl;
+            }
+        }
+        if (mapping.ports == 0) mapping.ports = g_fanOutput.AllPorts();
+        mapping.sendsMidi = config.midiMessageType != ControlMapping::MidiMessageType::NONE;
+        mapping.sendsOsc = g_oscOutput.IsOpen() && !config.oscAddress.empty();
+        if (mapping.sendsOsc) {
+            mapping.oscPrefix = OscOutput::EncodePrefix(config.oscAddress);
+            mapping.oscScaler.Build(config, OSC_OUTPUT_MAX);
+        }
+
+        encoded.pitchBend = MakeMidiMessage(0xE0 | config.midiChannel, 0, 0);
+        if (config.midiMessageType == ControlMapping::MidiMessageType::NOTE_ON_OFF) {
+            encoded.pressed = MakeMidiMessage(0x90 | config.midiChannel, config.midiNoteOrCCNumber, config.midiValueNoteOnVelocity);
+            encoded.released = MakeMidiMessage(0x80 | config.midiChannel, config.midiNoteOrCCNumber, 0);
+        } else if (config.midiMessageType == ControlMapping::MidiMessageType::PITCH_BEND) {
+            // A button bends fully up while held and returns to center.
+            encoded.pressed = MakeMidiMessage(0xE0 | config.midiChannel, 0x7F, 0x7F);
+            encoded.released = MakeMidiMessage(0xE0 | config.midiChannel, 0x00, 0x40);
+        } else {
+            encoded.pressed = MakeMidiMessage(0xB0 | config.midiChannel, config.midiNoteOrCCNumber, config.midiValueCCOn);
+            encoded.released = MakeMidiMessage(0xB0 | config.midiChannel, config.midiNoteOrCCNumber, config.midiValueCCOff);
+        }
+        // NRPN/RPN values go out as Data Entry, CC 6 (MSB) and CC 38 (LSB).
+        int valueNumber = encoded.axisFormat == EncodedMapping::AxisFormat::PARAMETER ? 6 : config.midiNoteOrCCNumber;
+        for (int value = 0; value < 128; ++value) {
+            encoded.values[value] = MakeMidiMessage(0xB0 | config.midiChannel, valueNumber, value);
+            encoded.lsbValues[value] = MakeMidiMessage(0xB0 | config.midiChannel, valueNumber + 32, value);
+        }
+    }
+    for (auto& port : g_selectedParameter) port.fill(-1);
+    g_oscOutput.SetKeyCount(g_mappings.size());
+    // Every profile shares the output ports, so the budget comes from the first profile, which also
+    // names the ports. Each port is its own link and gets the whole budget.
+    for (size_t i = 0; i < g_fanOutput.Count(); ++i) {
+        g_fanOutput.Port(i).scheduled.SetBudget(g_profiles.empty() ? 0 : g_profiles.front().midiBytesPerSecond);
     }
-    std::sort(configFiles.begin(), configFiles.end());
-    return configFiles;
 }
 
-bool PerformCalibration() {
-    if (g_currentConfig.control.isButton) return true;
+bool PerformCalibration(ControlMapping& config, size_t mapping) {
+    if (config.control.isButton) return true;
 
     auto do_countdown = [](const std::string& stageName) {
         for (int i = 5; i > 0; --i) {
@@ -674,13 +2978,13 @@ bool PerformCalibration() {
         std::cout << "\r" << std::string(50, ' ') << "\r" << std::flush;
     };
 
-    auto capture_hold_value = [](bool captureMin) -> LONG {
+    auto capture_hold_value = [mapping](bool captureMin) -> LONG {
         LONG extremeValue = captureMin ? std::numeric_limits<LONG>::max() : std::numeric_limits<LONG>::min();
         auto endTime = std::chrono::steady_clock::now() + std::chrono::seconds(5);
 
         while (std::chrono::steady_clock::now() < endTime) {
             auto time_left = std::chrono::duration_cast<std::chrono::seconds>(endTime - std::chrono::steady_clock::now()).count();
-            LONG current_val = g_currentValue.load();
+            LONG current_val = g_currentValues[mapping].load();
             if (captureMin) extremeValue = std::min(extremeValue, current_val);
             else extremeValue = std::max(extremeValue, current_val);
 
@@ -693,40 +2997,829 @@ bool PerformCalibration() {
     };
 
     ClearScreen();
-    std::cout << "--- Calibrating Axis: " << g_currentConfig.control.name << " ---\n\n";
+    std::cout << "--- Calibrating Axis: " << config.control.name << " ---\n\n";
     std::cout << "1. Move the control to its desired MINIMUM position.\n   Get ready!" << std::endl;
     do_countdown("MIN");
-    g_currentConfig.calibrationMinHid = capture_hold_value(true);
-    std::cout << "   Minimum value captured: " << g_currentConfig.calibrationMinHid << "\n\n";
+    config.calibrationMinHid = capture_hold_value(true);
+    std::cout << "   Minimum value captured: " << config.calibrationMinHid << "\n\n";
 
     std::cout << "2. Move the control to its desired MAXIMUM position.\n   Get ready!" << std::endl;
     do_countdown("MAX");
-    g_currentConfig.calibrationMaxHid = capture_hold_value(false);
-    std::cout << "   Maximum value captured: " << g_currentConfig.calibrationMaxHid << "\n\n";
+    config.calibrationMaxHid = capture_hold_value(false);
+    std::cout << "   Maximum value captured: " << config.calibrationMaxHid << "\n\n";
 
-    if (g_currentConfig.calibrationMinHid > g_currentConfig.calibrationMaxHid) {
+    if (config.calibrationMinHid > config.calibrationMaxHid) {
         std::cout << "Note: Min value was greater than Max value. Swapping." << std::endl;
-        std::swap(g_currentConfig.calibrationMinHid, g_currentConfig.calibrationMaxHid);
+        std::swap(config.calibrationMinHid, config.calibrationMaxHid);
     }
-    g_currentConfig.calibrationDone = true;
+    config.calibrationDone = true;
     std::cout << "Calibration complete. Press Enter to continue." << std::endl;
     ClearInputBuffer();
     std::cin.get();
     return true;
 }
 
+// ===================================================================================
+//
+// MIDI DISPATCH
+//
+// ===================================================================================
+
+void SendAxisMidiValue(MappingState& mapping, int midiVal, std::chrono::steady_clock::time_point now) {
+    const EncodedMapping& encoded = mapping.encoded;
+    g_fanOutput.Select(mapping.ports);
+    switch (encoded.axisFormat) {
+    case EncodedMapping::AxisFormat::CC7:
+        g_output->Send(encoded.values[midiVal]);
+        break;
+    case EncodedMapping::AxisFormat::CC14:
+    case EncodedMapping::AxisFormat::PARAMETER: {
+        bool selected = true;
+        if (encoded.axisFormat == EncodedMapping::AxisFormat::PARAMETER) {
+            // Only the ports whose receiver has another parameter selected get the select pair.
+            uint32_t stale = 0;
+            for (size_t port = 0; port < g_fanOutput.Count(); ++port) {
+                int& current = g_selectedParameter[port][encoded.channel];
+                if ((mapping.ports & (1u << port)) && current != encoded.parameterKey) {
+                    current = encoded.parameterKey;
+                    stale |= 1u << port;
+                }
+            }
+            selected = stale == 0;
+            if (!selected) {
+                g_fanOutput.Select(stale);
+                g_output->Send(encoded.selectMsb);
+                g_output->Send(encoded.selectLsb);
+                g_fanOutput.Select(mapping.ports);
+                g_parameterSelects++;
+            }
+        }
+        // A receiver clears the LSB when the MSB arrives, so the MSB goes first and only when it
+        // changed (or the parameter was just selected).
+        int msb = midiVal >> 7;
+        if (!selected || mapping.lastSentMidiValue < 0 || (mapping.lastSentMidiValue >> 7) != msb) {
+            g_output->Send(encoded.values[msb]);
+        } else {
+            g_msbSkipped++;
+        }
+        g_output->Send(encoded.lsbValues[midiVal & 0x7F]);
+        break;
+    }
+    case EncodedMapping::AxisFormat::PITCH_BEND: {
+        MidiMessage message = encoded.pitchBend;
+        message.bytes[1] = static_cast<unsigned char>(midiVal & 0x7F);
+        message.bytes[2] = static_cast<unsigned char>(midiVal >> 7);
+        g_output->Send(message);
+        break;
+    }
+    }
+    mapping.lastSentMidiValue = midiVal;
+    mapping.lastSendTime = now;
+}
+
+void SendButtonState(MappingState& mapping, bool pressed) {
+    if (pressed == (mapping.previousValue != 0)) return;
+    mapping.previousValue = pressed ? 1 : 0;
+    if (mapping.sendsOsc) g_oscOutput.Send(-1, mapping.oscPrefix, pressed ? 1.0f : 0.0f);
+    if (!mapping.sendsMidi) return;
+    if (mapping.encoded.axisFormat == EncodedMapping::AxisFormat::PARAMETER) {
+        // Buttons set the parameter's MSB to the CC on/off values.
+        int value = pressed ? mapping.config->midiValueCCOn : mapping.config->midiValueCCOff;
+        SendAxisMidiValue(mapping, (value & 0x7F) << 7, std::chrono::steady_clock::time_point());
+        return;
+    }
+    g_fanOutput.Select(mapping.ports);
+    g_output->SendUrgent(pressed ? mapping.encoded.pressed : mapping.encoded.released);
+}
+
+// OSC skips the MIDI step logic (hysteresis, rate limit): each frame sends the newest value.
+void SendAxisOsc(MappingState& mapping, LONG value) {
+    int position = mapping.oscScaler.Position(value);
+    if (position == mapping.lastOscPosition) return;
+    mapping.lastOscPosition = position;
+    const double scale = 1.0 / (static_cast<double>(OSC_OUTPUT_MAX) * (1 << AxisScaler::FRACTION_BITS));
+    g_oscOutput.Send(static_cast<int>(&mapping - g_mappings.data()), mapping.oscPrefix, static_cast<float>(position * scale));
+}
+
+void SendAxisValue(MappingState& mapping, LONG value) {
+    if (!mapping.scaler.Ready()) return;
+    if (mapping.sendsOsc) SendAxisOsc(mapping, value);
+    if (!mapping.sendsMidi) return;
+    int position = mapping.scaler.Position(value);
+    int midiVal = AxisScaler::Output(position);
+    int current = mapping.trailingPending ? mapping.trailingValue : mapping.lastSentMidiValue;
+    if (midiVal != current && current >= 0 && mapping.hysteresis > 0) {
+        // Step `current` spans positions [current*256 - 128, current*256 + 128); stay on it until
+        // the value is past that span by the hysteresis margin.
+        int centerOfStep = current << AxisScaler::FRACTION_BITS;
+        if (std::abs(position - centerOfStep) < AxisScaler::HALF_STEP + mapping.hysteresis) {
+            g_hysteresisHeld++;
+            return;
+        }
+    }
+    if (midiVal == current && mapping.scaler.InDeadzone(value)) g_deadzoneAbsorbed++;
+    if (mapping.sendInterval.count() == 0) {
+        if (midiVal != mapping.lastSentMidiValue) SendAxisMidiValue(mapping, midiVal, std::chrono::steady_clock::time_point());
+        return;
+    }
+
+    if (mapping.trailingPending) {
+        // Already waiting for the interval to end; just update what will be sent then.
+        if (mapping.trailingValue != midiVal) g_rateLimitSuperseded++;
+        mapping.trailingValue = midiVal;
+        return;
+    }
+    if (midiVal == mapping.lastSentMidiValue) return;
+    auto now = std::chrono::steady_clock::now();
+    if (now - mapping.lastSendTime >= mapping.sendInterval) {
+        SendAxisMidiValue(mapping, midiVal, now);
+        return;
+    }
+    mapping.trailingPending = true;
+    mapping.trailingValue = midiVal;
+    g_rateLimitDeferred++;
+    g_rateLimitedMappings.push_back(static_cast<uint16_t>(&mapping - g_mappings.data()));
+}
+
+// Sends every held value whose interval has ended. Returns when the next one is due, or
+// time_point::max() when nothing is held, so the caller can arm a timer instead of polling.
+std::chrono::steady_clock::time_point FlushRateLimitedMappings(std::chrono::steady_clock::time_point now) {
+    auto next = std::chrono::steady_clock::time_point::max();
+    size_t kept = 0;
+    for (uint16_t index : g_rateLimitedMappings) {
+        MappingState& mapping = g_mappings[index];
+        auto due = mapping.lastSendTime + mapping.sendInterval;
+        if (due <= now) {
+            mapping.trailingPending = false;
+            if (mapping.trailingValue != mapping.lastSentMidiValue) SendAxisMidiValue(mapping, mapping.trailingValue, now);
+        } else {
+            g_rateLimitedMappings[kept++] = index;
+            next = std::min(next, due);
+        }
+    }
+    g_rateLimitedMappings.resize(kept);
+    return next;
+}
+
+// Runs a new raw value through the mapping's filter. While the result still rounds to a different
+// output than the raw value, the mapping is kept settling so it reaches the resting value even if
+// the device sends nothing more.
+LONG FilterAxisValue(MappingState& mapping, LONG value, uint64_t timestampUs) {
+    if (!mapping.filter.Enabled() || !mapping.scaler.Ready()) return value;
+    mapping.rawValue = value;
+    LONG filtered = mapping.filter.Apply(value, timestampUs);
+    if (!mapping.settling && mapping.scaler.Scale(filtered) != mapping.scaler.Scale(value)) {
+        mapping.settling = true;
+        g_settlingMappings.push_back(static_cast<uint16_t>(&mapping - g_mappings.data()));
+    }
+    return filtered;
+}
+
+// Re-filters settling mappings against their last raw value every FILTER_SETTLE_INTERVAL.
+// Returns when the next one is due, or time_point::max() when none are settling.
+std::chrono::steady_clock::time_point FlushSettlingFilters(std::chrono::steady_clock::time_point now) {
+    const uint64_t nowUs = std::chrono::duration_cast<std::chrono::microseconds>(now.time_since_epoch()).count();
+    const uint64_t intervalUs = std::chrono::duration_cast<std::chrono::microseconds>(FILTER_SETTLE_INTERVAL).count();
+    auto next = std::chrono::steady_clock::time_point::max();
+    size_t kept = 0;
+    for (uint16_t index : g_settlingMappings) {
+        MappingState& mapping = g_mappings[index];
+        uint64_t due = mapping.filter.LastUs() + intervalUs;
+        if (due <= nowUs) {
+            LONG filtered = mapping.filter.Apply(mapping.rawValue, nowUs);
+            SendAxisValue(mapping, filtered);
+            if (mapping.scaler.Scale(filtered) == mapping.scaler.Scale(mapping.rawValue)) {
+                mapping.settling = false;
+                continue;
+            }
+            due = nowUs + intervalUs;
+        }
+        g_settlingMappings[kept++] = index;
+        next = std::min(next, std::chrono::steady_clock::time_point(std::chrono::microseconds(due)));
+    }
+    g_settlingMappings.resize(kept);
+    return next;
+}
+
+// Runs everything the dispatcher does on a timer and returns when it next needs to run.
+std::chrono::steady_clock::time_point RunDispatchTimers(std::chrono::steady_clock::time_point now) {
+    auto settleAt = FlushSettlingFilters(now); // may hand values to the rate limiter, so runs first
+    auto next = std::min(settleAt, FlushRateLimitedMappings(now));
+    for (size_t i = 0; i < g_fanOutput.Count(); ++i) next = std::min(next, g_fanOutput.Port(i).scheduled.Pump(now));
+    EndOutputFrame();
+    return next;
+}
+
+// Ends the current frame on every output: MIDI ports flush their stage and OSC sends its bundle.
+void EndOutputFrame() {
+    g_output->EndFrame();
+    g_oscOutput.EndFrame();
+}
+
+void DispatchInputEvent(const InputEvent& ev) {
+    MappingState& mapping = g_mappings[ev.mapping];
+    if (ev.flags & INPUT_EVENT_BUTTON) {
+        SendButtonState(mapping, ev.value != 0);
+    } else {
+        SendAxisValue(mapping, FilterAxisValue(mapping, ev.value, ev.timestampUs));
+    }
+}
+
+// Drains everything the input thread queued since the last pass. Button edges are always
+// sent in order; with the Coalesce policy only the newest queued axis value is sent.
+void DispatchQueuedInput() {
+    InputEvent ev;
+    while (g_inputQueue.TryPop(ev)) {
+        MappingState& mapping = g_mappings[ev.mapping];
+        if (!(ev.flags & INPUT_EVENT_BUTTON) && mapping.config->axisQueuePolicy == ControlMapping::AxisQueuePolicy::COALESCE) {
+            if (!mapping.axisPending) g_pendingAxisMappings.push_back(ev.mapping);
+            mapping.axisPending = true;
+            mapping.pendingValue = FilterAxisValue(mapping, ev.value, ev.timestampUs);
+        } else {
+            DispatchInputEvent(ev);
+        }
+    }
+    for (uint16_t index : g_pendingAxisMappings) {
+        MappingState& mapping = g_mappings[index];
+        mapping.axisPending = false;
+        SendAxisValue(mapping, mapping.pendingValue);
+    }
+    g_pendingAxisMappings.clear();
+    EndOutputFrame();
+}
+
+void PrintPortStatistics(const MidiPort& port) {
+    std::cout << "Frame coalescing: " << port.frame.collapsed << " of " << port.frame.staged
+              << " staged messages collapsed" << std::endl;
+    if (port.async.highWater > 0) {
+        auto line = [](const char* name, const AsyncMidiOutput::ClassStats& stats) {
+            std::cout << "  " << name << ": " << stats.queued << " queued, " << stats.dropped << " dropped, "
+                      << stats.coalesced << " coalesced, " << stats.blocked << " blocked\n";
+        };
+        const OutputDelayStats& latency = port.async.latency;
+        std::cout << "Output thread: queue high-water mark " << port.async.highWater << " of "
+                  << AsyncMidiOutput::QUEUE_CAPACITY << ", latency avg "
+                  << (latency.messages ? latency.totalDelayUs / latency.messages : 0) << " us, max " << latency.maxDelayUs << " us\n";
+        line("urgent ", port.async.urgent);
+        line("streams", port.async.stream);
+    }
+#ifndef _WIN32
+    if (port.raw.messages > 0) {
+        std::cout << "Raw MIDI: " << port.raw.messages << " messages in " << port.raw.bytesWritten << " bytes, "
+                  << port.raw.statusBytesSkipped << " status bytes saved by running status, "
+                  << port.raw.writeErrors << " write errors\n";
+    }
+#endif
+    if (port.scheduled.Budget() > 0) {
+        auto lane = [](const char* name, const ScheduledMidiOutput::LaneStats& stats) {
+            std::cout << "  " << name << ": " << stats.messages << " sent, queue delay avg "
+                      << (stats.messages ? stats.totalDelayUs / stats.messages : 0) << " us, max " << stats.maxDelayUs << " us\n";
+        };
+        std::cout << "Output budget " << port.scheduled.Budget() << " bytes/s: "
+                  << port.scheduled.superseded << " stream values superseded, "
+                  << port.scheduled.priorityOverflows << " priority overflows\n";
+        lane("priority lane", port.scheduled.priorityLane);
+        lane("stream lane  ", port.scheduled.streamLane);
+    }
+}
+
+void PrintDispatchStatistics() {
+    if (g_oscOutput.IsOpen()) {
+        std::cout << "OSC: " << g_oscOutput.messages << " messages in " << g_oscOutput.bundles << " bundles, "
+                  << g_oscOutput.collapsed << " collapsed, " << g_oscOutput.sendErrors << " send errors" << std::endl;
+    }
+    std::cout << "Rate limit: " << g_rateLimitDeferred << " values deferred, "
+              << g_rateLimitSuperseded << " superseded before sending" << std::endl;
+    std::cout << "Jitter suppression: " << g_hysteresisHeld << " held by hysteresis, "
+              << g_deadzoneAbsorbed << " absorbed by deadzones" << std::endl;
+    if (g_msbSkipped > 0 || g_parameterSelects > 0) {
+        std::cout << "14-bit values: " << g_msbSkipped << " sent without an MSB, "
+                  << g_parameterSelects << " NRPN/RPN parameter selects" << std::endl;
+    }
+    for (size_t i = 0; i < g_fanOutput.Count(); ++i) {
+        if (g_fanOutput.Count() > 1) std::cout << "Port " << i << ", " << g_fanOutput.Port(i).name << ":\n";
+        PrintPortStatistics(g_fanOutput.Port(i));
+    }
+}
+
+void PrintQueueStatistics() {
+    std::cout << "Queue: " << g_inputQueue.pushed.load() << " events, "
+              << g_inputQueue.overflowed.load() << " overflowed ("
+              << g_inputQueue.coalesced.load() << " axis coalesced, " << g_inputQueue.dropped.load()
+              << " dropped), max depth "
+              << g_inputQueue.maxDepth.load() << "/" << INPUT_QUEUE_CAPACITY
+              << ", " << g_dispatchWakeups.load() << " dispatcher sleeps" << std::endl;
+}
+
+// ===================================================================================
+//
+// BENCHMARKS
+//
+// ===================================================================================
+
+// The axis path as it was before AxisScaler: per-event double math. Kept as the reference.
+int ScaleAxisDouble(const ControlMapping& config, LONG value) {
+    LONG range = config.calibrationMaxHid - config.calibrationMinHid;
+    LONG clamped = std::max(config.calibrationMinHid, std::min(config.calibrationMaxHid, value));
+    double norm = (double)(clamped - config.calibrationMinHid) / range;
+    if (config.reverseAxis) norm = 1.0 - norm;
+    return (int)(norm * 127.0 + 0.5);
+}
+
+template <typename Body>
+double MeasureNsPerOp(size_t operations, Body&& body) {
+    auto start = std::chrono::steady_clock::now();
+    body();
+    auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    return static_cast<double>(elapsed) / static_cast<double>(operations);
+}
+
+void BenchmarkAxisScaling() {
+    ControlMapping mapping;
+    mapping.control.logicalMin = 0;
+    mapping.control.logicalMax = 65535;
+    mapping.calibrationMinHid = 1200;
+    mapping.calibrationMaxHid = 64000;
+    mapping.calibrationDone = true;
+    mapping.reverseAxis = true;
+
+    AxisScaler table;
+    table.Build(mapping, 127);
+    ControlMapping wide = mapping;
+    wide.control.logicalMin = -100000; // too wide for a table: exercises the integer path
+    AxisScaler integer;
+    integer.Build(wide, 127);
+
+    // A slow sweep with jitter, like a stick being moved, repeated.
+    std::vector<LONG> inputs(1 << 20);
+    uint32_t seed = 12345;
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        seed = seed * 1664525u + 1013904223u;
+        inputs[i] = static_cast<LONG>((i * 7) % 65536) + static_cast<LONG>(seed >> 28) - 8;
+    }
+
+    size_t mismatches = 0;
+    for (LONG v = -16; v <= 65551; ++v) {
+        int reference = ScaleAxisDouble(mapping, v);
+        if (table.Scale(v) != integer.Scale(v)) { std::cerr << "Table and integer paths disagree at " << v << std::endl; return; }
+        if (table.Scale(v) != reference) mismatches++;
+    }
+
+    const int rounds = 20;
+    const size_t operations = inputs.size() * rounds;
+    volatile int sink = 0;
+    double doubleNs = MeasureNsPerOp(operations, [&] {
+        int sum = 0;
+        for (int r = 0; r < rounds; ++r) for (LONG v : inputs) sum += ScaleAxisDouble(mapping, v);
+        sink = sum;
+    });
+    double tableNs = MeasureNsPerOp(operations, [&] {
+        int sum = 0;
+        for (int r = 0; r < rounds; ++r) for (LONG v : inputs) sum += table.Scale(v);
+        sink = sum;
+    });
+    double integerNs = MeasureNsPerOp(operations, [&] {
+        int sum = 0;
+        for (int r = 0; r < rounds; ++r) for (LONG v : inputs) sum += integer.Scale(v);
+        sink = sum;
+    });
+    (void)sink;
+
+    std::cout << "Axis scaling (16-bit axis, " << operations << " values):\n"
+              << std::fixed << std::setprecision(2)
+              << "  double path:  " << doubleNs << " ns/value\n"
+              << "  lookup table: " << tableNs << " ns/value\n"
+              << "  integer math: " << integerNs << " ns/value\n"
+              << "  " << mismatches << " of 65568 inputs differ from the double path\n";
+}
+
+// Pushes synthetic frames through frame assembly, scaling, encoding and the output chain main
+// builds (fan-out, frame coalescing, budget, output thread, and OSC), with a null port as the
+// backend. Reports the time and heap use per frame once warmed up. Returns false if the
+// steady state allocated.
+bool BenchmarkDispatch() {
+    NullMidiOutput sink;
+    MidiPort& port = g_primaryPort;
+    port.async.SetNext(sink);
+    bool oscOpen = g_oscOutput.Open("127.0.0.1:9"); // the discard port; nothing needs to listen
+
+    ControlMapping button;
+    button.control.isButton = true;
+    button.control.logicalMax = 1;
+    button.midiMessageType = ControlMapping::MidiMessageType::NOTE_ON_OFF;
+    button.midiNoteOrCCNumber = 36;
+    ControlMapping axis;
+    axis.control.logicalMax = 65535;
+    axis.calibrationMaxHid = 65535;
+    axis.calibrationDone = true;
+    axis.midiMessageType = ControlMapping::MidiMessageType::CC;
+    axis.midiNoteOrCCNumber = 1;
+    button.oscAddress = "/bench/button";
+    axis.oscAddress = "/bench/axis";
+#ifndef _WIN32
+    button.control.eventType = EV_KEY;
+    button.control.eventCode = BTN_SOUTH;
+    axis.control.eventType = EV_ABS;
+    axis.control.eventCode = ABS_X;
+#endif
+    g_profiles.assign(1, MidiMappingConfig());
+    g_profiles.front().mappings = {button, axis};
+    BuildMappingTable();
+    CompileMappings();
+    MidiMappingConfig defaults;
+    port.async.Start(defaults.urgentOutputPolicy, defaults.streamOutputPolicy);
+    g_singleThreaded = true;
+    g_dispatchActive = true;
+
+    const size_t frameCount = 1 << 16;
+#ifndef _WIN32
+    InputFrameAssembler frames;
+    for (size_t i = 0; i < g_mappings.size(); ++i) {
+        InputFrameAssembler::Slot slot;
+        slot.mapping = static_cast<uint16_t>(i);
+        frames.slots.push_back(slot);
+    }
+    frames.Rebuild();
+    std::vector<struct input_event> events;
+    for (size_t f = 0; f < frameCount; ++f) {
+        struct input_event ev = {};
+        ev.type = EV_ABS; ev.code = ABS_X; ev.value = static_cast<int>((f * 97) % 65536);
+        events.push_back(ev);
+        if (f % 8 == 0) {
+            ev.type = EV_KEY; ev.code = BTN_SOUTH; ev.value = (f / 8) % 2;
+            events.push_back(ev);
+        }
+        ev.type = EV_SYN; ev.code = SYN_REPORT; ev.value = 0;
+        events.push_back(ev);
+    }
+    auto run = [&] { for (const auto& ev : events) frames.Feed(ev); };
+#else
+    std::vector<InputEvent> events;
+    for (size_t f = 0; f < frameCount; ++f) {
+        InputEvent ev;
+        ev.mapping = 1; ev.value = static_cast<LONG>((f * 97) % 65536);
+        events.push_back(ev);
+        if (f % 8 == 0) {
+            ev.mapping = 0; ev.value = (f / 8) % 2; ev.flags = INPUT_EVENT_BUTTON;
+            events.push_back(ev);
+        }
+    }
+    auto run = [&] {
+        for (const auto& ev : events) {
+            DispatchInputEvent(ev);
+            EndOutputFrame();
+        }
+    };
+#endif
+    run(); // warm-up: first-use allocations inside the output layer are not steady state
+
+    const int rounds = 20;
+#ifdef JOYSTICKMIDI_COUNT_ALLOCATIONS
+    uint64_t allocationsBefore = g_allocationCount.load();
+    uint64_t bytesBefore = g_allocatedBytes.load();
+#endif
+    uint64_t messagesBefore = sink.messages.load();
+    uint64_t oscBefore = g_oscOutput.messages;
+    double frameNs = MeasureNsPerOp(frameCount * rounds, [&] {
+        for (int r = 0; r < rounds; ++r) run();
+    });
+#ifdef JOYSTICKMIDI_COUNT_ALLOCATIONS
+    uint64_t allocations = g_allocationCount.load() - allocationsBefore;
+    uint64_t bytes = g_allocatedBytes.load() - bytesBefore;
+#endif
+    g_dispatchActive = false;
+    g_singleThreaded = false;
+    port.async.Stop();
+    std::cout << "Dispatch (button + 16-bit axis, " << frameCount * rounds << " frames):\n"
+              << std::fixed << std::setprecision(2)
+              << "  " << frameNs << " ns/frame, " << (sink.messages.load() - messagesBefore) << " MIDI messages sent, "
+              << (oscOpen ? std::to_string(g_oscOutput.messages - oscBefore) + " OSC" : std::string("OSC skipped")) << "\n";
+    port.async.SetNext(port.rtMidiOutput);
+    g_oscOutput.Close();
+    bool passed = true;
+#ifdef JOYSTICKMIDI_COUNT_ALLOCATIONS
+    passed = allocations == 0;
+    std::cout << "  heap: " << bytes << " bytes in " << allocations << " allocations"
+              << (passed ? "" : " -- FAILED: the dispatch path must not allocate") << "\n";
+#else
+    std::cout << "  heap: not counted (configure with -DJOYSTICKMIDI_COUNT_ALLOCATIONS=ON)\n";
+#endif
+    return passed;
+}
+
+// Records the order messages reach a port, for the output checks below.
+class RecordingMidiOutput : public MidiOutput {
+public:
+    std::vector<MidiMessage> sent;
+    void Send(const unsigned char* bytes, size_t size) override {
+        MidiMessage message;
+        std::copy(bytes, bytes + std::min<size_t>(size, 3), message.bytes);
+        message.size = static_cast<uint8_t>(std::min<size_t>(size, 3));
+        sent.push_back(message);
+    }
+};
+
+// A CC14 axis that moves every frame, next to two other streams, on a link with less budget
+// than it needs. Every MSB that goes out must be followed by its LSB in the same turn.
+bool CheckScheduledCc14() {
+    RecordingMidiOutput port;
+    ScheduledMidiOutput scheduled(port);
+    scheduled.SetBudget(3000);
+    MidiOutput& output = scheduled;
+    auto end = std::chrono::steady_clock::now() + std::chrono::milliseconds(100);
+    for (int value = 0; std::chrono::steady_clock::now() < end; ++value) {
+        output.Send(MakeMidiMessage(0xB0, 1, value >> 7));
+        output.Send(MakeMidiMessage(0xB0, 33, value));
+        output.Send(MakeMidiMessage(0xB0, 7, value));
+        output.Send(MakeMidiMessage(0xB1, 7, value));
+        scheduled.Pump(std::chrono::steady_clock::now());
+    }
+    size_t msbs = 0;
+    size_t lsbs = 0;
+    bool paired = true;
+    for (size_t i = 0; i < port.sent.size(); ++i) {
+        if (port.sent[i].bytes[0] != 0xB0) continue;
+        if (port.sent[i].bytes[1] == 1) {
+            msbs++;
+            if (i + 1 == port.sent.size() || port.sent[i + 1].bytes[0] != 0xB0 || port.sent[i + 1].bytes[1] != 33) paired = false;
+        } else if (port.sent[i].bytes[1] == 33) {
+            lsbs++;
+        }
+    }
+    bool passed = paired && msbs > 0 && lsbs == msbs;
+    std::cout << "Output budget (CC14 axis + 2 CCs at 3000 bytes/s, 100 ms):\n"
+              << "  " << msbs << " MSBs, " << lsbs << " LSBs sent" << (passed ? "" : " -- FAILED: an LSB fell behind its MSB") << "\n";
+    return passed;
+}
+
+// A CC14 axis and fifteen other streams sent faster than a slow port takes them, so the
+// output queue stays full and values are parked. The port must never see an LSB ahead of the MSB
+// it was sent with. Both halves carry the same counter, so that shows up as a mismatch.
+bool CheckAsyncCc14() {
+    class SlowPort : public RecordingMidiOutput {
+    public:
+        void Send(const unsigned char* bytes, size_t size) override {
+            RecordingMidiOutput::Send(bytes, size);
+            std::this_thread::sleep_for(std::chrono::microseconds(20));
+        }
+    } port;
+    AsyncMidiOutput async(port);
+    async.Start(AsyncMidiOutput::Policy::BLOCK, AsyncMidiOutput::Policy::COALESCE);
+    MidiOutput& output = async;
+    auto end = std::chrono::steady_clock::now() + std::chrono::milliseconds(100);
+    for (int value = 0; std::chrono::steady_clock::now() < end; ++value) {
+        output.Send(MakeMidiMessage(0xB0, 1, value));
+        // Lets the port free a slot between the two halves, as a preempted dispatcher would.
+        std::this_thread::sleep_for(std::chrono::microseconds(50));
+        output.Send(MakeMidiMessage(0xB0, 33, value));
+        for (int channel = 1; channel < 16; ++channel) output.Send(MakeMidiMessage(0xB0 | channel, 7, value));
+        output.EndFrame();
+    }
+    async.Stop();
+    int msb = -1;
+    int lastKey = -1;
+    size_t pairs = 0;
+    bool passed = true;
+    for (const MidiMessage& message : port.sent) {
+        if (message.bytes[0] != 0xB0) continue;
+        if (message.bytes[1] == 1) {
+            msb = message.bytes[2];
+        } else if (message.bytes[1] == 33) {
+            if (message.bytes[2] != msb) passed = false;
+            pairs++;
+        }
+        lastKey = message.bytes[1];
+    }
+    passed = passed && async.stream.coalesced > 0 && lastKey == 33;
+    std::cout << "Output queue (CC14 axis + 15 CCs into a slow port, 100 ms):\n"
+              << "  " << pairs << " pairs sent, " << async.stream.coalesced << " values parked"
+              << (passed ? "" : " -- FAILED: an LSB went out ahead of its MSB") << "\n";
+    return passed;
+}
+
+#ifndef _WIN32
+// Per-message cost of each port backend, sending to a port with no subscribers so only the
+// library and syscall overhead is measured. Buffered ALSA drains every two messages, the size of
+// a busy input frame.
+void BenchmarkMidiBackends() {
+    const size_t messageCount = 1 << 16;
+    std::vector<MidiMessage> messages(messageCount);
+    for (size_t i = 0; i < messageCount; ++i) messages[i] = MakeMidiMessage(0xB0, 1, static_cast<int>(i & 0x7F));
+    auto run = [&](MidiOutput& output) {
+        return MeasureNsPerOp(messageCount, [&] {
+            for (size_t i = 0; i < messageCount; ++i) {
+                output.Send(messages[i]);
+                if (i & 1) output.EndFrame();
+            }
+        });
+    };
+
+    std::cout << "MIDI backends (" << messageCount << " CC messages, no subscribers):\n" << std::fixed << std::setprecision(2);
+    try {
+        RtMidiOut port;
+        port.openVirtualPort("JoystickMIDI Bench");
+        RtMidiOutput rtmidi(&port);
+        std::cout << "  RtMidi:               " << run(rtmidi) << " ns/message\n";
+    } catch (const RtMidiError& error) {
+        std::cout << "  RtMidi:               skipped (" << error.getMessage() << ")\n";
+    }
+    for (bool buffered : {false, true}) {
+        const char* name = buffered ? "  ALSA seq (buffered): " : "  ALSA seq (direct):   ";
+        AlsaSeqOutput alsa;
+        if (!alsa.Open("", buffered)) {
+            std::cout << name << "skipped (no sequencer)\n";
+            continue;
+        }
+        std::cout << name << run(alsa) << " ns/message\n";
+    }
+    for (bool runningStatus : {false, true}) {
+        RawMidiOutput raw;
+        if (!raw.Open("/dev/null", runningStatus)) continue;
+        double ns = run(raw);
+        std::cout << (runningStatus ? "  raw fd, running st.: " : "  raw fd (/dev/null):  ") << ns << " ns/message, "
+                  << static_cast<double>(raw.bytesWritten) / static_cast<double>(raw.messages) << " bytes/message\n";
+    }
+}
+#endif
+
+// Returns false if any of the built-in checks failed.
+bool RunBenchmarks() {
+    BenchmarkAxisScaling();
+    bool passed = BenchmarkDispatch();
+    passed = CheckScheduledCc14() && passed;
+    passed = CheckAsyncCc14() && passed;
+#ifndef _WIN32
+    BenchmarkMidiBackends();
+#endif
+    return passed;
+}
+
 // ===================================================================================
 //
 // MAIN APPLICATION
 //
 // ===================================================================================
 
-int main() {
+void PrintUsage(const char* program) {
+    std::cout << "Usage: " << program << " [options] [profile" << CONFIG_EXTENSION << " ...]\n"
+              << "  Profiles given on the command line are loaded without prompting; each one\n"
+              << "  adds a controller, and all of them share one input reactor and MIDI client.\n"
+              << "  --single-thread   Run input, MIDI output and display on one epoll loop (Linux)\n"
+              << "  --virtual-port[=NAME]\n"
+              << "                    Create a MIDI output port (default \"" << DEFAULT_VIRTUAL_PORT_NAME << "\") for other\n"
+              << "                    programs to subscribe to, instead of connecting to an existing one\n"
+              << "  --bench           Run the hot-path microbenchmarks and exit\n"
+              << "  --help            Show this help\n";
+}
+
+#ifdef _WIN32
+constexpr bool VIRTUAL_PORTS_SUPPORTED = false; // Windows MultiMedia cannot create ports
+#else
+constexpr bool VIRTUAL_PORTS_SUPPORTED = true;
+#endif
+
+// Opens the chosen port (an index into RtMidi's list) on the profile's backend. The raw MIDI
+// backend ignores the index and opens config.midiRawDevice; a virtual port ignores it too.
+bool OpenMidiPort(MidiPort& out, const MidiMappingConfig& config, unsigned int port) {
+    if (config.midiVirtualPort && VIRTUAL_PORTS_SUPPORTED && config.midiBackend != MidiMappingConfig::MidiBackend::RAW_MIDI) {
+        out.name = config.midiVirtualPortName + " (virtual)";
+#ifndef _WIN32
+        if (config.midiBackend != MidiMappingConfig::MidiBackend::RTMIDI) {
+            bool buffered = config.midiBackend == MidiMappingConfig::MidiBackend::ALSA_SEQ_BUFFERED;
+            if (!out.alsa.Open("", buffered, config.midiVirtualPortName)) return false;
+            out.async.SetNext(out.alsa);
+            return true;
+        }
+#endif
+        if (!out.CreateRtMidiClient()) return false;
+        try {
+            out.rtMidi->openVirtualPort(config.midiVirtualPortName);
+        } catch (const RtMidiError& error) {
+            std::cerr << "Error: Could not create virtual MIDI port '" << config.midiVirtualPortName << "'. "
+                      << error.getMessage() << std::endl;
+            return false;
+        }
+        out.async.SetNext(out.rtMidiOutput);
+        return true;
+    }
+    out.name = config.midiDeviceName;
+    if (config.midiBackend != MidiMappingConfig::MidiBackend::RTMIDI) {
+#ifndef _WIN32
+        if (config.midiBackend == MidiMappingConfig::MidiBackend::RAW_MIDI) {
+            out.name = config.midiRawDevice + " (raw)";
+            if (!out.raw.Open(config.midiRawDevice, config.midiRunningStatus)) return false;
+            out.async.SetNext(out.raw);
+            return true;
+        }
+        bool buffered = config.midiBackend == MidiMappingConfig::MidiBackend::ALSA_SEQ_BUFFERED;
+        if (!out.alsa.Open(g_midiOut.getPortName(port), buffered)) return false;
+        out.async.SetNext(out.alsa);
+        return true;
+#else
+        std::cerr << "Note: the ALSA and raw MIDI backends are Linux-only; using RtMidi." << std::endl;
+#endif
+    }
+    if (!out.CreateRtMidiClient()) return false;
+    out.rtMidi->openPort(port);
+    out.async.SetNext(out.rtMidiOutput);
+    return true;
+}
+
+// Opens the profile's midiExtraDeviceNames after its main port, on the same backend. Each one
+// connects to an existing port, or for raw MIDI opens the named device.
+bool OpenExtraMidiPorts(const MidiMappingConfig& config) {
+    for (const auto& name : config.midiExtraDeviceNames) {
+        MidiMappingConfig extra = config;
+        extra.midiVirtualPort = false;
+        extra.midiDeviceName = name;
+        extra.midiRawDevice = name;
+        int index = -1;
+        unsigned int portCount = g_midiOut.getPortCount();
+        for (unsigned int i = 0; i < portCount; ++i) {
+            if (g_midiOut.getPortName(i) == name) {
+                index = i;
+                break;
+            }
+        }
+        if (index == -1 && config.midiBackend != MidiMappingConfig::MidiBackend::RAW_MIDI) {
+            std::cerr << "Configured MIDI port '" << name << "' not found." << std::endl;
+            return false;
+        }
+        std::unique_ptr<MidiPort> port(new MidiPort());
+        if (!OpenMidiPort(*port, extra, static_cast<unsigned int>(std::max(index, 0)))) return false;
+        if (!g_fanOutput.Add(*port)) {
+            std::cerr << "Note: only " << MAX_MIDI_PORTS << " MIDI ports are supported; '" << name << "' is ignored." << std::endl;
+            break;
+        }
+        g_extraPorts.push_back(std::move(port));
+    }
+    return true;
+}
+
+// Starts reading every profile's input device; setup needs the input thread even in
+// single-threaded mode, because calibration samples live values.
+bool StartInput(bool needThread) {
+    BuildMappingTable();
+#ifndef _WIN32
+    if (!OpenInputDevices()) {
+        std::cerr << "No input device could be opened." << std::endl;
+        return false;
+    }
+#endif
+    if (needThread) g_inputThread = std::thread(InputMonitorLoop);
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    std::vector<std::string> profileFiles;
+    bool virtualPortRequested = false;
+    std::string virtualPortName = DEFAULT_VIRTUAL_PORT_NAME;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--single-thread") {
+        #ifdef _WIN32
+            std::cerr << "--single-thread is only available on Linux." << std::endl;
+        #else
+            g_singleThreaded = true;
+        #endif
+        } else if (arg == "--virtual-port" || arg.rfind("--virtual-port=", 0) == 0) {
+            virtualPortRequested = true;
+            if (arg.size() > 15) virtualPortName = arg.substr(15);
+        } else if (arg == "--bench") {
+            return RunBenchmarks() ? 0 : 1;
+        } else if (arg == "--help") {
+            PrintUsage(argv[0]);
+            return 0;
+        } else if (arg.rfind("--", 0) != 0) {
+            profileFiles.push_back(arg);
+        } else {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            PrintUsage(argv[0]);
+            return 1;
+        }
+    }
+
     ClearScreen();
     std::cout << "--- HID to MIDI Mapper ---\n\n";
     bool configLoaded = false;
 
-    auto configFiles = ListConfigurations(".");
+    if (!profileFiles.empty()) {
+        g_profiles.resize(profileFiles.size());
+        for (size_t i = 0; i < profileFiles.size(); ++i) {
+            if (!LoadConfiguration(profileFiles[i], g_profiles[i])) {
+                std::cerr << "Failed to load configuration '" << profileFiles[i] << "'." << std::endl; return 1;
+            }
+        }
+        configLoaded = true;
+    #ifdef _WIN32
+        if (g_profiles.size() > 1) std::cerr << "Note: only the first profile is monitored on Windows." << std::endl;
+    #endif
+    } else {
+        g_profiles.resize(1);
+    }
+    MidiMappingConfig& config = g_profiles.front();
+
+    auto configFiles = configLoaded ? std::vector<fs::path>() : ListConfigurations(".");
     if (!configFiles.empty()) {
         std::cout << "Found existing configurations:\n";
         for (size_t i = 0; i < configFiles.size(); ++i) {
@@ -737,7 +3830,7 @@ int main() {
         if (g_quitFlag) return 1;
 
         if (choice < (int)configFiles.size()) {
-            if (LoadConfiguration(configFiles[choice].string(), g_currentConfig)) {
+            if (LoadConfiguration(configFiles[choice].string(), config)) {
                 std::cout << "Configuration loaded successfully." << std::endl;
                 configLoaded = true;
             } else {
@@ -761,8 +3854,8 @@ int main() {
         int dev_choice = GetUserSelection(available_devices.size() - 1, 0);
         if (g_quitFlag) return 1;
 
-        g_currentConfig.hidDeviceName = available_devices[dev_choice].name;
-        g_currentConfig.hidDevicePath = available_devices[dev_choice].path;
+        config.hidDeviceName = available_devices[dev_choice].name;
+        config.hidDevicePath = available_devices[dev_choice].path;
 
         ClearScreen();
         std::cout << "--- Step 2: Select Control to Map ---\n";
@@ -776,7 +3869,7 @@ int main() {
             }
             auto available_controls = GetAvailableControls(g_preparsedData, available_devices[dev_choice].caps);
         #else
-            auto available_controls = GetAvailableControls(g_currentConfig.hidDevicePath);
+            auto available_controls = GetAvailableControls(config.hidDevicePath);
         #endif
 
         if (available_controls.empty()) {
@@ -786,46 +3879,94 @@ int main() {
         for (size_t i = 0; i < available_controls.size(); ++i) {
             std::cout << "[" << i << "] " << available_controls[i].name << (available_controls[i].isButton ? " (Button)" : " (Axis)") << std::endl;
         }
-        int ctrl_choice = GetUserSelection(available_controls.size() - 1, 0);
-        g_currentConfig.control = available_controls[ctrl_choice];
+        while (true) {
+            int ctrl_choice = GetUserSelection(available_controls.size() - 1, 0);
+            if (g_quitFlag) return 1;
+            ControlMapping mapping;
+            mapping.control = available_controls[ctrl_choice];
+            config.mappings.push_back(mapping);
+            std::cout << "Mapped " << mapping.control.name << ". Map another control? (0=No, 1=Yes): ";
+            if (GetUserSelection(1, 0) != 1) break;
+            std::cout << "Select the next control:\n";
+        }
 
         ClearScreen();
         std::cout << "--- Step 3: Select MIDI Output ---\n";
         unsigned int portCount = g_midiOut.getPortCount();
-        if (portCount == 0) {
-            std::cerr << "No MIDI output ports available." << std::endl; return 1;
+        int midi_choice = 0;
+        config.midiVirtualPortName = virtualPortName;
+        config.midiVirtualPort = virtualPortRequested && VIRTUAL_PORTS_SUPPORTED;
+        if (virtualPortRequested && !VIRTUAL_PORTS_SUPPORTED) {
+            std::cerr << "Note: virtual MIDI ports are not supported on Windows; choose an existing port." << std::endl;
         }
-        for (unsigned int i = 0; i < portCount; ++i) {
-            std::cout << "  [" << i << "]: " << g_midiOut.getPortName(i) << std::endl;
+        if (!config.midiVirtualPort) {
+            if (portCount == 0 && !VIRTUAL_PORTS_SUPPORTED) {
+                std::cerr << "No MIDI output ports available." << std::endl; return 1;
+            }
+            for (unsigned int i = 0; i < portCount; ++i) {
+                std::cout << "  [" << i << "]: " << g_midiOut.getPortName(i) << std::endl;
+            }
+            if (VIRTUAL_PORTS_SUPPORTED) {
+                std::cout << "  [" << portCount << "]: Create a virtual port named '" << virtualPortName << "'" << std::endl;
+            }
+            midi_choice = GetUserSelection(VIRTUAL_PORTS_SUPPORTED ? portCount : portCount - 1, 0);
+            if (g_quitFlag) return 1;
+            config.midiVirtualPort = midi_choice == static_cast<int>(portCount);
         }
-        int midi_choice = GetUserSelection(portCount - 1, 0);
-        g_midiOut.openPort(midi_choice);
-        g_currentConfig.midiDeviceName = g_midiOut.getPortName(midi_choice);
+        config.midiDeviceName = config.midiVirtualPort ? config.midiVirtualPortName : g_midiOut.getPortName(midi_choice);
+        if (!OpenMidiPort(g_primaryPort, config, midi_choice)) return 1;
 
-        g_inputThread = std::thread(InputMonitorLoop);
+        if (!StartInput(true)) return 1;
 
-        ClearScreen();
-        std::cout << "--- Step 4: Configure MIDI Mapping ---\n";
-        std::cout << "Select MIDI message type:\n[0] Note On/Off\n[1] CC\n";
-        g_currentConfig.midiMessageType = (GetUserSelection(1, 0) == 0) ? MidiMappingConfig::MidiMessageType::NOTE_ON_OFF : MidiMappingConfig::MidiMessageType::CC;
-        std::cout << "Enter MIDI Channel (1-16): ";
-        g_currentConfig.midiChannel = GetUserSelection(16, 1) - 1;
-        std::cout << "Enter MIDI Note/CC Number (0-127): ";
-        g_currentConfig.midiNoteOrCCNumber = GetUserSelection(127, 0);
-
-        if (g_currentConfig.midiMessageType == MidiMappingConfig::MidiMessageType::NOTE_ON_OFF) {
-            std::cout << "Enter Note On Velocity (1-127): ";
-            g_currentConfig.midiValueNoteOnVelocity = GetUserSelection(127, 1);
-        } else {
-            if (g_currentConfig.control.isButton) {
-                std::cout << "Enter CC Value when Pressed (0-127): ";
-                g_currentConfig.midiValueCCOn = GetUserSelection(127, 0);
-                std::cout << "Enter CC Value when Released (0-127): ";
-                g_currentConfig.midiValueCCOff = GetUserSelection(127, 0);
+        for (size_t i = 0; i < config.mappings.size(); ++i) {
+            ControlMapping& mapping = config.mappings[i];
+            ClearScreen();
+            std::cout << "--- Step 4: Configure MIDI Mapping (" << i + 1 << "/" << config.mappings.size() << ": " << mapping.control.name << ") ---\n";
+            std::cout << "Select MIDI message type:\n[0] Note On/Off\n[1] CC\n";
+            if (!mapping.control.isButton) std::cout << "[2] 14-bit CC (MSB/LSB pair)\n[3] Pitch Bend\n[4] NRPN\n[5] RPN\n";
+            const ControlMapping::MidiMessageType types[] = {
+                ControlMapping::MidiMessageType::NOTE_ON_OFF, ControlMapping::MidiMessageType::CC,
+                ControlMapping::MidiMessageType::CC_14BIT, ControlMapping::MidiMessageType::PITCH_BEND,
+                ControlMapping::MidiMessageType::NRPN, ControlMapping::MidiMessageType::RPN
+            };
+            int typeChoice = GetUserSelection(mapping.control.isButton ? 1 : 5, 0);
+            if (typeChoice < 0) {
+                g_quitFlag = true;
+                if (g_inputThread.joinable()) g_inputThread.join();
+                return 1;
+            }
+            mapping.midiMessageType = types[typeChoice];
+            std::cout << "Enter MIDI Channel (1-16): ";
+            mapping.midiChannel = GetUserSelection(16, 1) - 1;
+            if (mapping.midiMessageType == ControlMapping::MidiMessageType::PITCH_BEND) {
+                std::cout << "Enter center detent width (0-50% of the calibrated range): ";
+                mapping.centerDeadzone = GetUserSelection(50, 0) / 100.0;
+            } else if (mapping.midiMessageType == ControlMapping::MidiMessageType::NRPN ||
+                       mapping.midiMessageType == ControlMapping::MidiMessageType::RPN) {
+                std::cout << "Enter parameter number (0-16383): ";
+                mapping.midiNoteOrCCNumber = GetUserSelection(16383, 0);
+            } else if (mapping.midiMessageType == ControlMapping::MidiMessageType::CC_14BIT) {
+                std::cout << "Enter MIDI CC Number for the MSB (0-31; the LSB uses CC+32): ";
+                mapping.midiNoteOrCCNumber = GetUserSelection(31, 0);
             } else {
-                std::cout << "Reverse MIDI output? (0=No, 1=Yes): ";
-                g_currentConfig.reverseAxis = (GetUserSelection(1, 0) == 1);
-                PerformCalibration();
+                std::cout << "Enter MIDI Note/CC Number (0-127): ";
+                mapping.midiNoteOrCCNumber = GetUserSelection(127, 0);
+            }
+
+            if (mapping.midiMessageType == ControlMapping::MidiMessageType::NOTE_ON_OFF) {
+                std::cout << "Enter Note On Velocity (1-127): ";
+                mapping.midiValueNoteOnVelocity = GetUserSelection(127, 1);
+            } else {
+                if (mapping.control.isButton) {
+                    std::cout << "Enter CC Value when Pressed (0-127): ";
+                    mapping.midiValueCCOn = GetUserSelection(127, 0);
+                    std::cout << "Enter CC Value when Released (0-127): ";
+                    mapping.midiValueCCOff = GetUserSelection(127, 0);
+                } else {
+                    std::cout << "Reverse MIDI output? (0=No, 1=Yes): ";
+                    mapping.reverseAxis = (GetUserSelection(1, 0) == 1);
+                    PerformCalibration(mapping, i);
+                }
             }
         }
     } else { // Config was loaded
@@ -834,7 +3975,7 @@ int main() {
             auto devices = EnumerateHidDevices();
             bool found = false;
             for(auto& dev : devices) {
-                if (dev.path == g_currentConfig.hidDevicePath) {
+                if (dev.path == config.hidDevicePath) {
                     g_preparsedData = dev.preparsedData;
                     dev.preparsedData = nullptr; // Prevent destructor from freeing it
                     found = true;
@@ -845,22 +3986,46 @@ int main() {
                 std::cerr << "Configured HID device not found." << std::endl; return 1;
             }
         #endif
-        g_inputThread = std::thread(InputMonitorLoop);
+        if (!StartInput(!g_singleThreaded)) return 1;
+        if (virtualPortRequested) {
+            config.midiVirtualPort = true;
+            config.midiVirtualPortName = virtualPortName;
+        }
+        if (config.midiVirtualPort && !VIRTUAL_PORTS_SUPPORTED) {
+            std::cerr << "Note: virtual MIDI ports are not supported on Windows; connecting to '"
+                      << config.midiDeviceName << "' instead." << std::endl;
+            config.midiVirtualPort = false;
+        }
         unsigned int portCount = g_midiOut.getPortCount();
         int midi_port = -1;
         for (unsigned int i = 0; i < portCount; ++i) {
-            if (g_midiOut.getPortName(i) == g_currentConfig.midiDeviceName) {
+            if (g_midiOut.getPortName(i) == config.midiDeviceName) {
                 midi_port = i;
                 break;
             }
         }
-        if (midi_port == -1) {
-            std::cerr << "Configured MIDI port '" << g_currentConfig.midiDeviceName << "' not found." << std::endl;
+#ifndef _WIN32
+        bool needsPort = config.midiBackend != MidiMappingConfig::MidiBackend::RAW_MIDI && !config.midiVirtualPort;
+#else
+        bool needsPort = !config.midiVirtualPort;
+#endif
+        if (midi_port == -1 && needsPort) {
+            std::cerr << "Configured MIDI port '" << config.midiDeviceName << "' not found." << std::endl;
+            g_quitFlag = true;
+            if (g_inputThread.joinable()) g_inputThread.join();
+            return 1;
+        }
+        if (!OpenMidiPort(g_primaryPort, config, static_cast<unsigned int>(std::max(midi_port, 0))) || !OpenExtraMidiPorts(config)) {
             g_quitFlag = true;
             if (g_inputThread.joinable()) g_inputThread.join();
             return 1;
         }
-        g_midiOut.openPort(midi_port);
+        for (const auto& profile : g_profiles) {
+            if (!config.midiVirtualPort && profile.midiDeviceName != config.midiDeviceName) {
+                std::cerr << "Note: '" << profile.hidDeviceName << "' is configured for MIDI port '" << profile.midiDeviceName
+                          << "' but all profiles send to '" << config.midiDeviceName << "'." << std::endl;
+            }
+        }
     }
 
     if (!configLoaded) {
@@ -873,75 +4038,118 @@ int main() {
             if (!string_ends_with(saveFilename, CONFIG_EXTENSION)) {
                 saveFilename += CONFIG_EXTENSION;
             }
-            if (SaveConfiguration(g_currentConfig, saveFilename)) {
+            if (SaveConfiguration(config, saveFilename)) {
                 std::cout << "Configuration saved to " << saveFilename << std::endl;
             }
         }
     }
 
+    if (!config.oscTarget.empty() && !g_oscOutput.Open(config.oscTarget)) {
+        g_quitFlag = true;
+        if (g_inputThread.joinable()) g_inputThread.join();
+        return 1;
+    }
+
+#ifndef _WIN32
+    if (g_singleThreaded) {
+        // Setup may have used the input thread for calibration; the event loop takes over from here.
+        g_inputStop = true;
+        if (g_inputThread.joinable()) g_inputThread.join();
+    }
+#endif
+
     ClearScreen();
     std::cout << "--- Monitoring Active ---\n";
-    std::cout << "Device: " << g_currentConfig.hidDeviceName << std::endl;
-    std::cout << "Control: " << g_currentConfig.control.name << std::endl;
-    std::cout << "MIDI Port: " << g_currentConfig.midiDeviceName << std::endl;
+    for (const auto& profile : g_profiles) {
+        std::cout << "Device: " << profile.hidDeviceName << std::endl;
+        for (const auto& mapping : profile.mappings) {
+            std::cout << "  Control: " << mapping.control.name << std::endl;
+        }
+    }
+    for (size_t i = 0; i < g_fanOutput.Count(); ++i) {
+        std::cout << "MIDI Port: " << g_fanOutput.Port(i).name << std::endl;
+    }
+    if (g_oscOutput.IsOpen()) std::cout << "OSC: " << config.oscTarget << std::endl;
     std::cout << "(Press Enter to exit on Linux, or close window)\n\n";
 
+#ifndef _WIN32
+    if (g_singleThreaded) {
+        CompileMappings();
+        // A raw MIDI write blocks until the device takes the bytes, so those ports keep their
+        // output thread rather than stalling the loop.
+        for (size_t i = 0; i < g_fanOutput.Count(); ++i) {
+            MidiPort& port = g_fanOutput.Port(i);
+            if (port.raw.IsOpen()) port.async.Start(config.urgentOutputPolicy, config.streamOutputPolicy);
+        }
+        g_dispatchActive = true;
+        RunEventLoop();
+        for (size_t i = 0; i < g_fanOutput.Count(); ++i) g_fanOutput.Port(i).async.Stop();
+        std::cout << "\n\nExiting..." << std::endl;
+        PrintInputStatistics();
+        PrintDispatchStatistics();
+        if (g_midiOut.isPortOpen()) g_midiOut.closePort();
+        return 0;
+    }
+#endif
+
+    // The loop sleeps until the input thread queues something, so an idle device costs no
+    // wakeups. The display is redrawn at most 60 times a second, and only when the value moved.
+    // MIDI writes happen on their own thread so a slow port never holds up dispatch.
+    const auto displayInterval = std::chrono::milliseconds(1000 / 60);
+    CompileMappings();
+    for (size_t i = 0; i < g_fanOutput.Count(); ++i) {
+        g_fanOutput.Port(i).async.Start(config.urgentOutputPolicy, config.streamOutputPolicy);
+    }
+    g_dispatchActive = true;
+    DisplayMonitoringOutput();
+    uint64_t displayedGeneration = g_valueGeneration.load();
     auto lastDisplayTime = std::chrono::steady_clock::now();
     while (!g_quitFlag) {
+        DispatchQueuedInput();
+
+        // Sleep until new input, the next rate-limited value is due, or a pending redraw.
         auto now = std::chrono::steady_clock::now();
-        if (now - lastDisplayTime > std::chrono::milliseconds(1000 / 60)) {
-            DisplayMonitoringOutput();
-            lastDisplayTime = now;
-        }
-
-        if (g_valueChanged.exchange(false)) {
-            std::vector<unsigned char> message;
-            if (g_currentConfig.control.isButton) {
-                bool pressed = g_currentValue.load() != 0;
-                if (pressed != (g_previousValue != 0)) {
-                    if (g_currentConfig.midiMessageType == MidiMappingConfig::MidiMessageType::NOTE_ON_OFF) {
-                        message = {(unsigned char)((pressed ? 0x90 : 0x80) | g_currentConfig.midiChannel), (unsigned char)g_currentConfig.midiNoteOrCCNumber, (unsigned char)(pressed ? g_currentConfig.midiValueNoteOnVelocity : 0)};
-                    } else {
-                        message = {(unsigned char)(0xB0 | g_currentConfig.midiChannel), (unsigned char)g_currentConfig.midiNoteOrCCNumber, (unsigned char)(pressed ? g_currentConfig.midiValueCCOn : g_currentConfig.midiValueCCOff)};
-                    }
-                    if (!message.empty()) g_midiOut.sendMessage(&message);
-                }
-            } else { // Axis
-                if (g_currentConfig.calibrationDone) {
-                    LONG range = g_currentConfig.calibrationMaxHid - g_currentConfig.calibrationMinHid;
-                    if (range > 0) {
-                        LONG clamped = std::max(g_currentConfig.calibrationMinHid, std::min(g_currentConfig.calibrationMaxHid, g_currentValue.load()));
-                        double norm = (double)(clamped - g_currentConfig.calibrationMinHid) / range;
-                        if (g_currentConfig.reverseAxis) norm = 1.0 - norm;
-                        int midiVal = (int)(norm * 127.0 + 0.5);
-                        if (midiVal != g_lastSentMidiValue) {
-                            message = {(unsigned char)(0xB0 | g_currentConfig.midiChannel), (unsigned char)g_currentConfig.midiNoteOrCCNumber, (unsigned char)midiVal};
-                            g_midiOut.sendMessage(&message);
-                            g_lastSentMidiValue = midiVal;
-                        }
-                    }
-                }
+        auto wakeAt = RunDispatchTimers(now);
+        if (g_valueGeneration.load() != displayedGeneration) {
+            if (now - lastDisplayTime >= displayInterval) {
+                displayedGeneration = g_valueGeneration.load();
+                DisplayMonitoringOutput();
+                lastDisplayTime = now;
+            } else {
+                wakeAt = std::min(wakeAt, lastDisplayTime + displayInterval);
             }
-            g_previousValue = g_currentValue.load();
         }
 
+        g_dispatchWake.Arm();
+        if (g_inputQueue.Empty() && !g_quitFlag) {
+            g_dispatchWakeups++;
         #ifndef _WIN32
-        {
-            std::lock_guard<std::mutex> lock(g_consoleMutex);
-            struct timeval tv = {0L, 0L};
-            fd_set fds;
-            FD_ZERO(&fds);
-            FD_SET(0, &fds);
-            if (select(1, &fds, NULL, NULL, &tv) > 0) {
+            struct timespec timeout = {};
+            bool timed = wakeAt != std::chrono::steady_clock::time_point::max();
+            if (timed) {
+                auto remaining = std::max<int64_t>(0, std::chrono::duration_cast<std::chrono::nanoseconds>(wakeAt - now).count());
+                timeout.tv_sec = remaining / 1000000000;
+                timeout.tv_nsec = remaining % 1000000000;
+            }
+            struct pollfd pfds[2] = {{g_dispatchWake.Fd(), POLLIN, 0}, {0, POLLIN, 0}};
+            if (ppoll(pfds, 2, timed ? &timeout : nullptr, nullptr) > 0 && (pfds[1].revents & POLLIN)) {
                 g_quitFlag = true;
             }
-        }
+        #else
+            g_dispatchWake.WaitUntil(wakeAt);
         #endif
-        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        g_dispatchWake.Disarm();
     }
 
     std::cout << "\n\nExiting..." << std::endl;
+    for (size_t i = 0; i < g_fanOutput.Count(); ++i) g_fanOutput.Port(i).async.Stop();
     if (g_inputThread.joinable()) g_inputThread.join();
+#ifndef _WIN32
+    PrintInputStatistics();
+#endif
+    PrintQueueStatistics();
+    PrintDispatchStatistics();
     if (g_midiOut.isPortOpen()) g_midiOut.closePort();
     return 0;
 }